@@ -0,0 +1,379 @@
+/* Render benchmark of the weather views and the drawing primitives
+
+   usage: bench [-m mode] [-n frames] [-o result.csv] [-b baseline.csv] [-t percent] [-c percent]
+
+   -m  direct|async|fb|dl|task, or all (default)
+   -n  frames per case (default 20)
+   -o  write the results to a file instead of stdout
+   -b  compare the results with a saved run
+   -t  allowed increase of transactions, bytes and bus time (default 1%)
+   -c  allowed increase of CPU time (default: reported only)
+
+   Each frame starts from the screen the app shows after its setup, which
+   is drawn and flushed outside of the measurement. Every column is the
+   mean of one frame:
+
+   case,mode,frames,transactions,bytes,bus_us,cpu_us
+
+   bus_us is modelled for a 40MHz SPI clock. cpu_us is the CPU time of the
+   driver, on all threads, less the time spent in the emulated panel.
+   The exit status is 1 if a transfer failed or a metric regressed.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "ili9340.h"
+#include "fontx.h"
+#include "view.h"
+#include "ili9340_emu.h"
+#include "weather_fixture.h"
+
+#define FREQUENCY 40000000
+#define MAX_RESULTS 128
+
+typedef struct {
+	char name[32];
+	char mode[8];
+	int frames;
+	double transactions;
+	double bytes;
+	double bus_us;
+	double cpu_us;
+} RESULT_t;
+
+typedef struct {
+	TFT_t * dev;
+	FontxFile * fx;
+	uint8_t fontWidth;
+	uint8_t fontHeight;
+	const WEATHER_t * weather;
+	int frame;
+} BENCH_t;
+
+typedef void (*view_t)(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+
+static const char * modes[] = { "direct", "async", "fb", "dl", "task" };
+
+static uint64_t cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The screen after the setup in tft()
+static void setup_screen(BENCH_t * bench)
+{
+	uint8_t ascii[44];
+	lcdFillScreen(bench->dev, BLACK);
+	sprintf((char *)ascii, "World Weather %.12s", bench->weather->title);
+	uint16_t title_len = strlen((char *)ascii) * bench->fontWidth;
+	uint16_t xpos_title = 0;
+	if (SCREEN_WIDTH > title_len) xpos_title = (SCREEN_WIDTH - title_len) / 2;
+	lcdDrawString(bench->dev, bench->fx, xpos_title, bench->fontHeight-1, ascii, YELLOW);
+}
+
+static void draw_view(BENCH_t * bench, view_t view)
+{
+	(*view)(bench->dev, *bench->weather, bench->fx, bench->fontWidth, bench->fontHeight);
+}
+
+static void draw_view1(BENCH_t * bench) { draw_view(bench, view1); }
+static void draw_view2(BENCH_t * bench) { draw_view(bench, view2); }
+static void draw_view3(BENCH_t * bench) { draw_view(bench, view3); }
+static void draw_view4(BENCH_t * bench) { draw_view(bench, view4); }
+static void draw_view5(BENCH_t * bench) { draw_view(bench, view5); }
+static void draw_view6(BENCH_t * bench) { draw_view(bench, view6); }
+
+static void draw_fillscreen(BENCH_t * bench)
+{
+	lcdFillScreen(bench->dev, (bench->frame & 1) ? BLUE : GRAY);
+}
+
+static void draw_string(BENCH_t * bench)
+{
+	uint16_t ypos = (bench->fontHeight*4)-1;
+	for(int i=0;i<6;i++) {
+		lcdDrawString(bench->dev, bench->fx, 0, ypos, (uint8_t *)"01-16: 8.5  5.1  8.9 Heavy", CYAN);
+		ypos = ypos + bench->fontHeight;
+	}
+}
+
+// Current temperature readout, three times the font size
+static void draw_bigtemp(BENCH_t * bench)
+{
+	lcdSetFontScale(bench->dev, 3);
+	lcdDrawString(bench->dev, bench->fx, 0, (bench->fontHeight*4)-1, (uint8_t *)"-12.5C", WHITE);
+	lcdSetFontFill(bench->dev, BLACK);
+	lcdDrawString(bench->dev, bench->fx, 0, (bench->fontHeight*7)-1, (uint8_t *)" 21.5C", WHITE);
+	lcdUnsetFontFill(bench->dev);
+	lcdUnsetFontScale(bench->dev);
+}
+
+static void draw_line(BENCH_t * bench)
+{
+	for(int i=0;i<16;i++) {
+		lcdDrawLine(bench->dev, 0, bench->fontHeight, i*(SCREEN_WIDTH/16), SCREEN_HEIGHT-1, WHITE);
+		lcdDrawLine(bench->dev, SCREEN_WIDTH-1, bench->fontHeight, i*(SCREEN_WIDTH/16), SCREEN_HEIGHT-1, RED);
+	}
+}
+
+static void draw_fillcircle(BENCH_t * bench)
+{
+	lcdDrawFillCircle(bench->dev, SCREEN_WIDTH/2, (SCREEN_HEIGHT+bench->fontHeight)/2, 100, PURPLE);
+}
+
+static void draw_bmp(BENCH_t * bench)
+{
+	bmp_display(bench->dev, IMAGE_DIR "/images1/hc.bmp", bench->fontHeight*2, SCREEN_WIDTH);
+}
+
+// One row of the title rolling through the header
+static void prepare_marquee(BENCH_t * bench)
+{
+	lcdSetMarquee(bench->dev, bench->fx, bench->fontHeight-1, (uint8_t *)"World Weather Santa Cruz de Tenerife", YELLOW);
+	lcdFlush(bench->dev);
+}
+
+static void draw_marquee(BENCH_t * bench)
+{
+	lcdMarqueeScroll(bench->dev);
+}
+
+typedef struct {
+	const char * name;
+	void (*draw)(BENCH_t *);
+	const WEATHER_t * weather;
+	void (*prepare)(BENCH_t *);
+} CASE_t;
+
+static const CASE_t cases[] = {
+	{ .name = "view1", .draw = draw_view1, .weather = &weather_fixture_tokyo },
+	{ .name = "view2", .draw = draw_view2, .weather = &weather_fixture_tokyo },
+	{ .name = "view3", .draw = draw_view3, .weather = &weather_fixture_tokyo },
+	{ .name = "view4", .draw = draw_view4, .weather = &weather_fixture_tokyo },
+	{ .name = "view5", .draw = draw_view5, .weather = &weather_fixture_tokyo },
+	{ .name = "view6", .draw = draw_view6, .weather = &weather_fixture_tokyo },
+	{ .name = "view1/snow", .draw = draw_view1, .weather = &weather_fixture_snow },
+	{ .name = "view2/snow", .draw = draw_view2, .weather = &weather_fixture_snow },
+	{ .name = "view3/snow", .draw = draw_view3, .weather = &weather_fixture_snow },
+	{ .name = "view4/snow", .draw = draw_view4, .weather = &weather_fixture_snow },
+	{ .name = "view5/snow", .draw = draw_view5, .weather = &weather_fixture_snow },
+	{ .name = "view6/snow", .draw = draw_view6, .weather = &weather_fixture_snow },
+	{ .name = "lcdFillScreen", .draw = draw_fillscreen, .weather = &weather_fixture_tokyo },
+	{ .name = "lcdDrawString", .draw = draw_string, .weather = &weather_fixture_tokyo },
+	{ .name = "lcdSetFontScale", .draw = draw_bigtemp, .weather = &weather_fixture_tokyo },
+	{ .name = "lcdDrawLine", .draw = draw_line, .weather = &weather_fixture_tokyo },
+	{ .name = "lcdDrawFillCircle", .draw = draw_fillcircle, .weather = &weather_fixture_tokyo },
+	{ .name = "bmp_display", .draw = draw_bmp, .weather = &weather_fixture_tokyo },
+	{ .name = "lcdMarqueeScroll", .draw = draw_marquee, .weather = &weather_fixture_tokyo, .prepare = prepare_marquee },
+};
+
+// Run every case in one draw mode
+static int bench_mode(const char * mode, int frames, FontxFile * fx, RESULT_t * results, uint32_t * errors)
+{
+	TFT_t dev;
+	memset(&dev, 0, sizeof(dev));
+	EMU_t * emu = emu_master_init(&dev, SCREEN_WIDTH, SCREEN_HEIGHT);
+	emu->frequency = FREQUENCY;
+	lcdInit(&dev, 0x9341, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0);
+
+	if (strcmp(mode, "direct") != 0) lcdSetAsync(&dev);
+	if (strcmp(mode, "task") == 0) lcdSetFlushTask(&dev, PRO_CPU_NUM);
+	if (strcmp(mode, "fb") == 0) lcdSetFrameBuffer(&dev);
+	if (strcmp(mode, "dl") == 0) lcdSetDisplayList(&dev);
+
+	BENCH_t bench;
+	uint8_t buffer[FontxGlyphBufSize];
+	GetFontx(fx, 0, buffer, &bench.fontWidth, &bench.fontHeight);
+	bench.dev = &dev;
+	bench.fx = fx;
+	lcdSetFontDirection(&dev, 0);
+	lcdSetFontFill(&dev, BLACK);
+
+	int count = 0;
+	for(size_t i=0;i<sizeof(cases)/sizeof(cases[0]);i++) {
+		const CASE_t * c = &cases[i];
+		RESULT_t * result = &results[count++];
+		memset(result, 0, sizeof(RESULT_t));
+		snprintf(result->name, sizeof(result->name), "%s", c->name);
+		snprintf(result->mode, sizeof(result->mode), "%s", mode);
+		result->frames = frames;
+		bench.weather = c->weather;
+
+		uint64_t cpu = 0;
+		EMU_STATS_t total;
+		memset(&total, 0, sizeof(total));
+		for(int frame=0;frame<frames;frame++) {
+			bench.frame = frame;
+			lcdUnsetMarquee(&dev);
+			setup_screen(&bench);
+			if (c->prepare) c->prepare(&bench);
+			lcdFlush(&dev);
+			lcdFence(&dev);
+			total.errors += emu->stats.errors;
+			emu_reset_stats(emu);
+
+			uint64_t start = cpu_ns();
+			c->draw(&bench);
+			lcdFlush(&dev);
+			lcdFence(&dev);
+			uint64_t end = cpu_ns();
+
+			EMU_STATS_t stats;
+			emu_get_stats(emu, &stats);
+			total.transactions += stats.transactions;
+			total.bytes += stats.bytes;
+			total.bus_ns += stats.bus_ns;
+			total.errors += stats.errors;
+			cpu += (end - start) - stats.cpu_ns;
+			emu_reset_stats(emu);
+		}
+		lcdUnsetMarquee(&dev);
+		result->transactions = (double)total.transactions / frames;
+		result->bytes = (double)total.bytes / frames;
+		result->bus_us = total.bus_ns / 1e3 / frames;
+		result->cpu_us = cpu / 1e3 / frames;
+		*errors += total.errors;
+	}
+
+	if (strcmp(mode, "task") == 0) lcdUnsetFlushTask(&dev);
+	if (strcmp(mode, "fb") == 0) lcdUnsetFrameBuffer(&dev);
+	if (strcmp(mode, "dl") == 0) lcdUnsetDisplayList(&dev);
+	return count;
+}
+
+static void write_results(FILE * fp, RESULT_t * results, int count)
+{
+	fprintf(fp, "case,mode,frames,transactions,bytes,bus_us,cpu_us\n");
+	for(int i=0;i<count;i++) {
+		RESULT_t * r = &results[i];
+		fprintf(fp, "%s,%s,%d,%.1f,%.1f,%.1f,%.1f\n",
+			r->name, r->mode, r->frames, r->transactions, r->bytes, r->bus_us, r->cpu_us);
+	}
+}
+
+static int read_results(const char * path, RESULT_t * results, int max)
+{
+	FILE * fp = fopen(path, "r");
+	if (fp == NULL) return -1;
+	char line[256];
+	int count = 0;
+	while (count < max && fgets(line, sizeof(line), fp)) {
+		RESULT_t * r = &results[count];
+		if (sscanf(line, "%31[^,],%7[^,],%d,%lf,%lf,%lf,%lf",
+			r->name, r->mode, &r->frames, &r->transactions, &r->bytes, &r->bus_us, &r->cpu_us) == 7) count++;
+	}
+	fclose(fp);
+	return count;
+}
+
+// Print one metric and tell if it grew beyond the limit
+static bool compare_metric(const char * metric, double base, double value, double limit)
+{
+	double change = (base != 0) ? (value - base) * 100 / base : (value != 0) ? 100 : 0;
+	bool regressed = limit >= 0 && change > limit;
+	fprintf(stderr, " %s %.1f->%.1f(%+.1f%%)%s", metric, base, value, change, regressed ? "!" : "");
+	return regressed;
+}
+
+static int compare_results(RESULT_t * base, int base_count, RESULT_t * results, int count, double threshold, double cpu_threshold)
+{
+	int regressions = 0;
+	int missing = 0;
+	for(int i=0;i<count;i++) {
+		RESULT_t * r = &results[i];
+		RESULT_t * b = NULL;
+		for(int j=0;j<base_count;j++) {
+			if (strcmp(base[j].name, r->name) == 0 && strcmp(base[j].mode, r->mode) == 0) b = &base[j];
+		}
+		if (b == NULL) {
+			missing++;
+			continue;
+		}
+		bool regressed = false;
+		fprintf(stderr, "%s,%s:", r->name, r->mode);
+		regressed |= compare_metric("transactions", b->transactions, r->transactions, threshold);
+		regressed |= compare_metric("bytes", b->bytes, r->bytes, threshold);
+		regressed |= compare_metric("bus_us", b->bus_us, r->bus_us, threshold);
+		regressed |= compare_metric("cpu_us", b->cpu_us, r->cpu_us, cpu_threshold);
+		fprintf(stderr, "\n");
+		if (regressed) regressions++;
+	}
+	fprintf(stderr, "%d of %d cases regressed, %d not in the baseline\n", regressions, count, missing);
+	return regressions;
+}
+
+int main(int argc, char **argv)
+{
+	const char * mode = "all";
+	const char * output = NULL;
+	const char * baseline = NULL;
+	int frames = 20;
+	double threshold = 1.0;
+	double cpu_threshold = -1;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:o:b:t:c:")) != -1) {
+		switch (opt) {
+			case 'm': mode = optarg; break;
+			case 'n': frames = atoi(optarg); break;
+			case 'o': output = optarg; break;
+			case 'b': baseline = optarg; break;
+			case 't': threshold = atof(optarg); break;
+			case 'c': cpu_threshold = atof(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-m mode] [-n frames] [-o result.csv] [-b baseline.csv] [-t percent] [-c percent]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (frames < 1) frames = 1;
+	esp_log_level_set("*", ESP_LOG_WARN);
+
+	FontxFile fx[2];
+	InitFontx(fx, FONT_DIR "/ILGH24XB.FNT", "");
+
+	static RESULT_t results[MAX_RESULTS];
+	int count = 0;
+	uint32_t errors = 0;
+	for(size_t i=0;i<sizeof(modes)/sizeof(modes[0]);i++) {
+		if (strcmp(mode, "all") != 0 && strcmp(mode, modes[i]) != 0) continue;
+		count += bench_mode(modes[i], frames, fx, &results[count], &errors);
+	}
+	if (count == 0) {
+		fprintf(stderr, "unknown mode %s\n", mode);
+		return 2;
+	}
+
+	FILE * fp = stdout;
+	if (output) {
+		fp = fopen(output, "w");
+		if (fp == NULL) {
+			fprintf(stderr, "cannot write %s\n", output);
+			return 2;
+		}
+	}
+	write_results(fp, results, count);
+	if (output) fclose(fp);
+
+	int status = 0;
+	if (errors) {
+		fprintf(stderr, "%"PRIu32" protocol errors\n", errors);
+		status = 1;
+	}
+	if (baseline) {
+		static RESULT_t base[MAX_RESULTS];
+		int base_count = read_results(baseline, base, MAX_RESULTS);
+		if (base_count < 0) {
+			fprintf(stderr, "cannot read %s\n", baseline);
+			return 2;
+		}
+		if (compare_results(base, base_count, results, count, threshold, cpu_threshold)) status = 1;
+	}
+	return status;
+}
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Generate WEATHER_t fixtures for the benchmark from fonts/test.json
+
+usage: fixture.py [test.json] [weather_fixture.c]
+
+The fields are copied the way JSONtoStruct() in main/m5stack.c does it,
+including cJSON clamping large integers to INT_MAX.
+"""
+import json
+import os
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+INT_MAX = 2**31 - 1
+INT_MIN = -2**31
+
+WEATHER = ['title', 'woeid', 'sun_set', 'latt_long', 'time',
+	'timezone_name', 'timezone', 'sun_rise', 'location_type']
+DAILY = ['wind_speed', 'applicable_date', 'predictability',
+	'weather_state_abbr', 'weather_state_name', 'created',
+	'wind_direction', 'air_pressure', 'humidity', 'visibility',
+	'the_temp', 'min_temp', 'max_temp', 'id', 'wind_direction_compass']
+
+
+def value(v):
+	if isinstance(v, str):
+		return json.dumps(v)
+	if isinstance(v, bool) or not isinstance(v, (int, float)):
+		raise ValueError(v)
+	if isinstance(v, int):
+		return str(min(max(v, INT_MIN), INT_MAX))
+	return repr(float(v))
+
+
+def snow(root):
+	# Same days with snow and frost, so view1 and view4 take their other branches
+	root = json.loads(json.dumps(root))
+	for day in root['consolidated_weather']:
+		day['weather_state_abbr'] = 's'
+		day['weather_state_name'] = 'Snow'
+		for key in ('the_temp', 'min_temp', 'max_temp'):
+			day[key] = -day[key]
+	return root
+
+
+def struct(name, root):
+	lines = ['const WEATHER_t %s = {' % name]
+	for key in WEATHER:
+		lines.append('\t.%s = %s,' % (key, value(root[key])))
+	lines.append('\t.daily = {')
+	for day in root['consolidated_weather'][:6]:
+		lines.append('\t\t{')
+		for key in DAILY:
+			lines.append('\t\t\t.%s = %s,' % (key, value(day[key])))
+		lines.append('\t\t},')
+	lines.append('\t},')
+	lines.append('};')
+	return '\n'.join(lines)
+
+
+def main():
+	src = sys.argv[1] if len(sys.argv) > 1 else os.path.join(HERE, '..', 'fonts', 'test.json')
+	dst = sys.argv[2] if len(sys.argv) > 2 else os.path.join(HERE, 'weather_fixture.c')
+	with open(src) as f:
+		root = json.load(f)
+	out = ['/* Generated by fixture.py from fonts/test.json. Do not edit. */',
+		'#include "weather_fixture.h"',
+		'',
+		struct('weather_fixture_tokyo', root),
+		'',
+		struct('weather_fixture_snow', snow(root)),
+		'']
+	with open(dst, 'w') as f:
+		f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,135 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// A task is a thread with a notification counter
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t notify;
+	const char * name;
+	void (*code)(void *);
+	void * parameters;
+} HOST_TASK_t;
+
+static __thread HOST_TASK_t * current;
+static pthread_key_t current_key;
+static pthread_once_t current_once = PTHREAD_ONCE_INIT;
+
+// The task of a thread is freed when the thread exits
+static void host_task_free(void * arg)
+{
+	HOST_TASK_t * task = arg;
+	pthread_mutex_destroy(&task->mutex);
+	pthread_cond_destroy(&task->cond);
+	free(task);
+}
+
+static void host_task_key(void)
+{
+	pthread_key_create(&current_key, host_task_free);
+}
+
+static HOST_TASK_t * host_task_new(const char * name)
+{
+	HOST_TASK_t * task = calloc(1, sizeof(HOST_TASK_t));
+	assert(task != NULL);
+	pthread_mutex_init(&task->mutex, NULL);
+	pthread_cond_init(&task->cond, NULL);
+	task->name = name;
+	return task;
+}
+
+static void host_task_set_current(HOST_TASK_t * task)
+{
+	pthread_once(&current_once, host_task_key);
+	pthread_setspecific(current_key, task);
+	current = task;
+}
+
+static void * host_task_start(void * arg)
+{
+	HOST_TASK_t * task = arg;
+	host_task_set_current(task);
+	task->code(task->parameters);
+	return NULL;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+	(void)xTicksToDelay;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	if (current == NULL) host_task_set_current(host_task_new("main"));
+	return current;
+}
+
+const char * pcTaskGetName(TaskHandle_t xTask)
+{
+	HOST_TASK_t * task = xTask ? xTask : xTaskGetCurrentTaskHandle();
+	return task->name;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+	(void)xTask;
+	return 1;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*pvTaskCode)(void *), const char * pcName, uint32_t usStackDepth, void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pxCreatedTask, BaseType_t xCoreID)
+{
+	(void)usStackDepth;
+	(void)uxPriority;
+	(void)xCoreID;
+	HOST_TASK_t * task = host_task_new(pcName);
+	task->code = pvTaskCode;
+	task->parameters = pvParameters;
+	if (pxCreatedTask) *pxCreatedTask = task;
+	if (pthread_create(&task->thread, NULL, host_task_start, task) != 0) return pdFAIL;
+	pthread_detach(task->thread);
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTask)
+{
+	// Only a task deleting itself is supported
+	assert(xTask == NULL || xTask == current);
+	pthread_exit(NULL);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+	(void)xTicksToWait;
+	HOST_TASK_t * task = xTaskGetCurrentTaskHandle();
+	pthread_mutex_lock(&task->mutex);
+	while (task->notify == 0) {
+		pthread_cond_wait(&task->cond, &task->mutex);
+	}
+	uint32_t notify = task->notify;
+	task->notify = xClearCountOnExit ? 0 : notify - 1;
+	pthread_mutex_unlock(&task->mutex);
+	return notify;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+	HOST_TASK_t * task = xTaskToNotify;
+	pthread_mutex_lock(&task->mutex);
+	task->notify++;
+	pthread_cond_signal(&task->cond);
+	pthread_mutex_unlock(&task->mutex);
+	return pdPASS;
+}
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "ili9340.h"
+#include "ili9340_emu.h"
+
+#define TAG "EMU"
+
+// MADCTL bits
+#define MADCTL_MY	0x80
+#define MADCTL_MX	0x40
+#define MADCTL_MV	0x20
+#define MADCTL_BGR	0x08
+
+// Panel state after reset
+static void emu_reset(EMU_t * emu)
+{
+	emu->command = 0;
+	emu->previous = 0;
+	emu->argn = 0;
+	emu->xs = 0;
+	emu->xe = emu->width - 1;
+	emu->ys = 0;
+	emu->ye = emu->height - 1;
+	emu->cx = 0;
+	emu->cy = 0;
+	emu->ram_write = false;
+	emu->high = -1;
+	emu->madctl = 0;
+	emu->tfa = 0;
+	emu->vsa = emu->height;
+	emu->bfa = 0;
+	emu->vsp = 0;
+	emu->inversion = false;
+	emu->display_on = false;
+}
+
+// Write a pixel at a column and page address
+// MV exchanges the two addresses, and MX and MY mirror them.
+static void emu_put(EMU_t * emu, uint16_t col, uint16_t page, uint16_t color)
+{
+	bool mv = (emu->madctl & MADCTL_MV) != 0;
+	uint16_t cols = mv ? emu->height : emu->width;
+	uint16_t pages = mv ? emu->width : emu->height;
+	if (col >= cols || page >= pages) {
+		emu->stats.errors++;
+		return;
+	}
+	if (emu->madctl & MADCTL_MX) col = cols - 1 - col;
+	if (emu->madctl & MADCTL_MY) page = pages - 1 - page;
+	uint16_t x = mv ? page : col;
+	uint16_t y = mv ? col : page;
+	emu->gram[y * emu->width + x] = color;
+	emu->stats.pixels++;
+}
+
+static void emu_command(EMU_t * emu, uint8_t cmd)
+{
+	emu->stats.commands++;
+	emu->previous = emu->command;
+	emu->command = cmd;
+	emu->argn = 0;
+	emu->ram_write = false;
+	emu->high = -1;
+
+	switch (cmd) {
+	case 0x01:	// Software Reset
+		emu_reset(emu);
+		break;
+	case 0x20:	// Display Inversion OFF
+		emu->inversion = false;
+		break;
+	case 0x21:	// Display Inversion ON
+		emu->inversion = true;
+		break;
+	case 0x28:	// Display OFF
+		emu->display_on = false;
+		break;
+	case 0x29:	// Display ON
+		emu->display_on = true;
+		break;
+	case 0x2C:	// Memory Write
+		emu->cx = emu->xs;
+		emu->cy = emu->ys;
+		emu->ram_write = true;
+		break;
+	case 0x3C:	// Memory Write Continue
+		// Only defined after Memory Write or Memory Write Continue
+		if (emu->previous != 0x2C && emu->previous != 0x3C) {
+			ESP_LOGW(TAG, "Memory Write Continue after 0x%02x", emu->previous);
+			emu->stats.errors++;
+		}
+		emu->ram_write = true;
+		break;
+	}
+}
+
+static void emu_data(EMU_t * emu, uint8_t data)
+{
+	if (emu->ram_write) {
+		if (emu->high < 0) {
+			emu->high = data;
+			return;
+		}
+		emu_put(emu, emu->cx, emu->cy, (emu->high << 8) | data);
+		emu->high = -1;
+		if (emu->cx++ >= emu->xe) {
+			emu->cx = emu->xs;
+			if (emu->cy++ >= emu->ye) emu->cy = emu->ys;
+		}
+		return;
+	}
+
+	if (emu->argn < (int)sizeof(emu->args)) emu->args[emu->argn] = data;
+	emu->argn++;
+	uint8_t * args = emu->args;
+	switch (emu->command) {
+	case 0x2A:	// Column Address Set
+		if (emu->argn == 4) {
+			emu->xs = (args[0] << 8) | args[1];
+			emu->xe = (args[2] << 8) | args[3];
+		}
+		break;
+	case 0x2B:	// Page Address Set
+		if (emu->argn == 4) {
+			emu->ys = (args[0] << 8) | args[1];
+			emu->ye = (args[2] << 8) | args[3];
+		}
+		break;
+	case 0x33:	// Vertical Scrolling Definition
+		if (emu->argn == 6) {
+			emu->tfa = (args[0] << 8) | args[1];
+			emu->vsa = (args[2] << 8) | args[3];
+			emu->bfa = (args[4] << 8) | args[5];
+		}
+		break;
+	case 0x36:	// Memory Access Control
+		if (emu->argn == 1) emu->madctl = data;
+		break;
+	case 0x37:	// Vertical Scrolling Start Address
+		if (emu->argn == 2) emu->vsp = (args[0] << 8) | args[1];
+		break;
+	}
+}
+
+// Run one transfer through the panel and account for its bus time
+static void emu_transfer(EMU_t * emu, const uint8_t * data, size_t length, int16_t dc, uint32_t overhead_ns)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	emu->stats.transactions++;
+	emu->stats.bytes += length;
+	emu->stats.bus_ns += overhead_ns + (uint64_t)length * 8 * 1000000000 / emu->frequency;
+	for(size_t i=0;i<length;i++) {
+		if (dc) {
+			emu_data(emu, data[i]);
+		} else {
+			emu_command(emu, data[i]);
+		}
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+	emu->stats.cpu_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+}
+
+static void emu_transport_result(void * ctx)
+{
+	EMU_t * emu = ctx;
+	if (emu->queued == emu->done) {
+		ESP_LOGW(TAG, "No transfer in flight");
+		emu->stats.errors++;
+		return;
+	}
+	// The data of a queued transfer is read only now, as the DMA would
+	EMU_TRANS_t * trans = &emu->trans[emu->done % SPI_QUEUE_SIZE];
+	const uint8_t * data = trans->data ? trans->data : trans->tx_data;
+	emu_transfer(emu, data, trans->length, trans->dc, emu->interrupt_ns);
+	emu->done++;
+}
+
+// Transfers in flight must be collected before a blocking one
+static void emu_check_idle(EMU_t * emu)
+{
+	if (emu->queued == emu->done) return;
+	ESP_LOGW(TAG, "Blocking transfer with %d in flight", (int)(emu->queued - emu->done));
+	emu->stats.errors++;
+	while (emu->queued != emu->done) emu_transport_result(emu);
+}
+
+static void emu_transport_polling(void * ctx, const uint8_t * data, size_t length, int16_t dc)
+{
+	EMU_t * emu = ctx;
+	emu_check_idle(emu);
+	emu->stats.polling++;
+	emu_transfer(emu, data, length, dc, emu->polling_ns);
+}
+
+static void emu_transport_transmit(void * ctx, const uint8_t * data, size_t length, int16_t dc)
+{
+	EMU_t * emu = ctx;
+	emu_check_idle(emu);
+	emu->stats.interrupt++;
+	emu_transfer(emu, data, length, dc, emu->interrupt_ns);
+}
+
+static void emu_transport_queue(void * ctx, const uint8_t * data, size_t length, int16_t dc)
+{
+	EMU_t * emu = ctx;
+	if (emu->queued - emu->done == SPI_QUEUE_SIZE) {
+		ESP_LOGW(TAG, "Transfer queue overflow");
+		emu->stats.errors++;
+		emu_transport_result(emu);
+	}
+	EMU_TRANS_t * trans = &emu->trans[emu->queued % SPI_QUEUE_SIZE];
+	if (length <= sizeof(trans->tx_data)) {
+		memcpy(trans->tx_data, data, length);
+		trans->data = NULL;
+	} else {
+		trans->data = data;
+	}
+	trans->length = length;
+	trans->dc = dc;
+	emu->stats.interrupt++;
+	emu->queued++;
+}
+
+static void emu_transport_backlight(void * ctx, int level)
+{
+	EMU_t * emu = ctx;
+	emu->backlight = level;
+}
+
+static const LCD_TRANSPORT_t emu_transport = {
+	.polling = emu_transport_polling,
+	.transmit = emu_transport_transmit,
+	.queue = emu_transport_queue,
+	.result = emu_transport_result,
+	.backlight = emu_transport_backlight,
+};
+
+// Attach an emulated panel of width x height pixels
+// The bus runs at 40MHz, and the overheads are rough figures for
+// the ESP32 SPI master driver.
+EMU_t * emu_master_init(TFT_t * dev, uint16_t width, uint16_t height)
+{
+	EMU_t * emu = calloc(1, sizeof(EMU_t));
+	assert(emu != NULL);
+	emu->frequency = 40000000;
+	emu->polling_ns = 5000;
+	emu->interrupt_ns = 15000;
+	emu->bgr = true;
+	emu->width = width;
+	emu->height = height;
+	emu->gram = calloc(width * height, sizeof(uint16_t));
+	assert(emu->gram != NULL);
+	emu_reset(emu);
+	emu->backlight = false;
+
+	dev->_dc = -1;
+	dev->_bl = -1;
+	lcdInitTransport(dev, &emu_transport, emu);
+	return emu;
+}
+
+// Detach and free an emulated panel
+void emu_master_deinit(TFT_t * dev, EMU_t * emu)
+{
+	lcdDeinitTransport(dev);
+	free(emu->gram);
+	free(emu);
+}
+
+void emu_get_stats(EMU_t * emu, EMU_STATS_t * stats)
+{
+	*stats = emu->stats;
+}
+
+void emu_reset_stats(EMU_t * emu)
+{
+	memset(&emu->stats, 0, sizeof(EMU_STATS_t));
+}
+
+// Pixel in GRAM
+uint16_t emu_get_pixel(EMU_t * emu, uint16_t x, uint16_t y)
+{
+	return emu->gram[y * emu->width + x];
+}
+
+// What the panel shows, as 8-bit RGB
+// Scrolling, inversion, the display switch and the backlight are applied.
+void emu_snapshot(EMU_t * emu, uint8_t * rgb)
+{
+	bool scroll = (emu->tfa + emu->vsa + emu->bfa == emu->height) && emu->vsa > 0
+		&& emu->vsp >= emu->tfa && emu->vsp < emu->tfa + emu->vsa;
+	bool swap = ((emu->madctl & MADCTL_BGR) != 0) != emu->bgr;
+	for(int y=0;y<emu->height;y++) {
+		int row = y;
+		if (scroll && y >= emu->tfa && y < emu->tfa + emu->vsa) {
+			row = emu->tfa + (y - emu->tfa + emu->vsp - emu->tfa) % emu->vsa;
+		}
+		for(int x=0;x<emu->width;x++) {
+			uint16_t color = emu->gram[row * emu->width + x];
+			if (emu->inversion) color = ~color;
+			uint8_t r = (color >> 11) & 0x1F;
+			uint8_t g = (color >> 5) & 0x3F;
+			uint8_t b = color & 0x1F;
+			if (swap) {
+				uint8_t t = r;
+				r = b;
+				b = t;
+			}
+			if (!emu->display_on || !emu->backlight) r = g = b = 0;
+			*rgb++ = (r << 3) | (r >> 2);
+			*rgb++ = (g << 2) | (g >> 4);
+			*rgb++ = (b << 3) | (b >> 2);
+		}
+	}
+}
+
+bool emu_save_ppm(EMU_t * emu, const char * path)
+{
+	FILE * fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	size_t size = emu->width * emu->height * 3;
+	uint8_t * rgb = malloc(size);
+	emu_snapshot(emu, rgb);
+	fprintf(fp, "P6\n%d %d\n255\n", emu->width, emu->height);
+	fwrite(rgb, 1, size, fp);
+	free(rgb);
+	return fclose(fp) == 0;
+}
+
+static uint32_t png_crc(uint32_t crc, const uint8_t * data, size_t length)
+{
+	crc = ~crc;
+	for(size_t i=0;i<length;i++) {
+		crc ^= data[i];
+		for(int k=0;k<8;k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static void png_put32(uint8_t * p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void png_chunk(FILE * fp, const char * type, const uint8_t * data, size_t length)
+{
+	uint8_t head[8];
+	png_put32(head, length);
+	memcpy(&head[4], type, 4);
+	uint32_t crc = png_crc(0, &head[4], 4);
+	crc = png_crc(crc, data, length);
+	uint8_t tail[4];
+	png_put32(tail, crc);
+	fwrite(head, 1, 8, fp);
+	fwrite(data, 1, length, fp);
+	fwrite(tail, 1, 4, fp);
+}
+
+// PNG with stored (uncompressed) deflate blocks, so no zlib is needed
+bool emu_save_png(EMU_t * emu, const char * path)
+{
+	FILE * fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+
+	size_t stride = emu->width * 3;
+	size_t size = emu->height * (stride + 1);
+	uint8_t * rgb = malloc(emu->width * emu->height * 3);
+	uint8_t * raw = malloc(size);
+	emu_snapshot(emu, rgb);
+	for(int y=0;y<emu->height;y++) {
+		raw[y * (stride + 1)] = 0;	// No filter
+		memcpy(&raw[y * (stride + 1) + 1], &rgb[y * stride], stride);
+	}
+
+	size_t blocks = (size + 65534) / 65535;
+	uint8_t * idat = malloc(2 + size + blocks * 5 + 4);
+	size_t n = 0;
+	idat[n++] = 0x78;
+	idat[n++] = 0x01;
+	for(size_t pos=0;pos<size;pos+=65535) {
+		size_t length = size - pos;
+		if (length > 65535) length = 65535;
+		idat[n++] = (pos + length == size) ? 1 : 0;
+		idat[n++] = length & 0xFF;
+		idat[n++] = length >> 8;
+		idat[n++] = ~length & 0xFF;
+		idat[n++] = (~length >> 8) & 0xFF;
+		memcpy(&idat[n], &raw[pos], length);
+		n += length;
+	}
+	uint32_t a = 1, b = 0;
+	for(size_t i=0;i<size;i++) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	png_put32(&idat[n], (b << 16) | a);
+	n += 4;
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	fwrite(signature, 1, 8, fp);
+	uint8_t ihdr[13];
+	png_put32(&ihdr[0], emu->width);
+	png_put32(&ihdr[4], emu->height);
+	ihdr[8] = 8;	// Bit depth
+	ihdr[9] = 2;	// RGB
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+	png_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+	png_chunk(fp, "IDAT", idat, n);
+	png_chunk(fp, "IEND", NULL, 0);
+
+	free(idat);
+	free(raw);
+	free(rgb);
+	return fclose(fp) == 0;
+}
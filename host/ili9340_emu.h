@@ -0,0 +1,70 @@
+#ifndef _ILI9340_EMU_H_
+#define _ILI9340_EMU_H_
+
+#include "ili9340.h"
+
+// Bus activity seen by the emulator
+typedef struct {
+	uint32_t transactions;	// All transfers
+	uint32_t polling;	// Transfers sent by polling
+	uint32_t interrupt;	// Transfers sent with the interrupt
+	uint32_t commands;	// Command bytes
+	uint64_t bytes;		// Bytes on the wire
+	uint64_t pixels;	// Pixels written into GRAM
+	uint32_t errors;	// Protocol errors
+	uint64_t bus_ns;	// Modelled bus time
+	uint64_t cpu_ns;	// Host CPU time spent emulating the panel
+} EMU_STATS_t;
+
+// A queued transfer
+typedef struct {
+	const uint8_t * data;
+	uint8_t tx_data[4];
+	size_t length;
+	int16_t dc;
+} EMU_TRANS_t;
+
+// Emulated ILI9341 on an SPI bus
+typedef struct {
+	// Configuration, which may be changed after emu_master_init
+	uint32_t frequency;	// SPI clock in Hz
+	uint32_t polling_ns;	// Overhead of a polled transfer
+	uint32_t interrupt_ns;	// Overhead of a transfer with the interrupt
+	bool bgr;		// The panel has a BGR color filter
+
+	// Panel
+	uint16_t width;
+	uint16_t height;
+	uint16_t * gram;
+	uint8_t command;	// Last command
+	uint8_t previous;	// Command before the last one
+	uint8_t args[8];
+	int argn;
+	uint16_t xs, xe, ys, ye;	// Column and page address
+	uint16_t cx, cy;		// Memory write pointer
+	bool ram_write;
+	int high;		// First byte of a pixel, or -1
+	uint8_t madctl;
+	uint16_t tfa, vsa, bfa, vsp;	// Vertical scrolling
+	bool inversion;
+	bool display_on;
+	bool backlight;
+
+	// Transfers started by queue() and not yet collected
+	EMU_TRANS_t trans[SPI_QUEUE_SIZE];
+	uint32_t queued;
+	uint32_t done;
+
+	EMU_STATS_t stats;
+} EMU_t;
+
+EMU_t * emu_master_init(TFT_t * dev, uint16_t width, uint16_t height);
+void emu_master_deinit(TFT_t * dev, EMU_t * emu);
+void emu_get_stats(EMU_t * emu, EMU_STATS_t * stats);
+void emu_reset_stats(EMU_t * emu);
+uint16_t emu_get_pixel(EMU_t * emu, uint16_t x, uint16_t y);
+void emu_snapshot(EMU_t * emu, uint8_t * rgb);
+bool emu_save_ppm(EMU_t * emu, const char * path);
+bool emu_save_png(EMU_t * emu, const char * path);
+
+#endif /* _ILI9340_EMU_H_ */
@@ -0,0 +1,16 @@
+#ifndef _HOST_ESP_CPU_H_
+#define _HOST_ESP_CPU_H_
+
+#include <stdint.h>
+#include <time.h>
+
+// The host has no cycle counter that is cheap to read, so a cycle
+// is one nanosecond of the monotonic clock.
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+#endif /* _HOST_ESP_CPU_H_ */
@@ -0,0 +1,6 @@
+#ifndef _HOST_ESP_SPIFFS_H_
+#define _HOST_ESP_SPIFFS_H_
+
+// Fonts and images are read from the host file system
+
+#endif /* _HOST_ESP_SPIFFS_H_ */
@@ -0,0 +1,30 @@
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+// Just enough of FreeRTOS to build the LCD driver on Linux
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void * TaskHandle_t;
+
+#define portTICK_PERIOD_MS	1
+#define portMAX_DELAY		0xffffffff
+#define pdMS_TO_TICKS(ms)	((TickType_t)(ms))
+#define pdTRUE			1
+#define pdFALSE			0
+#define pdPASS			1
+#define pdFAIL			0
+#define configASSERT(x)		assert(x)
+
+#define PRO_CPU_NUM		0
+#define APP_CPU_NUM		1
+
+#define IRAM_ATTR
+
+#endif /* _HOST_FREERTOS_H_ */
@@ -0,0 +1,19 @@
+#ifndef _HOST_TASK_H_
+#define _HOST_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+// Tasks are POSIX threads. Cores and priorities are ignored, and
+// vTaskDelay does not sleep, so the emulated panel runs at full speed.
+
+void vTaskDelay(TickType_t xTicksToDelay);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+const char * pcTaskGetName(TaskHandle_t xTask);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask);
+BaseType_t xTaskCreatePinnedToCore(void (*pvTaskCode)(void *), const char * pcName, uint32_t usStackDepth, void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pxCreatedTask, BaseType_t xCoreID);
+void vTaskDelete(TaskHandle_t xTask);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+
+#endif /* _HOST_TASK_H_ */
@@ -0,0 +1,101 @@
+/* Draw a test screen on the emulated panel and save it
+
+   usage: snapshot [direct|async|fb|dl|task] [output.png|output.ppm]
+*/
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+
+#include "ili9340.h"
+#include "fontx.h"
+#include "ili9340_emu.h"
+
+#define SCREEN_WIDTH  320
+#define SCREEN_HEIGHT 240
+
+static void draw(TFT_t * dev, FontxFile * fx)
+{
+	uint8_t buffer[FontxGlyphBufSize];
+	uint8_t fontWidth;
+	uint8_t fontHeight;
+	GetFontx(fx, 0, buffer, &fontWidth, &fontHeight);
+
+	lcdFillScreen(dev, BLACK);
+	lcdSetFontDirection(dev, DIRECTION0);
+	lcdDrawString(dev, fx, 40, fontHeight-1, (uint8_t *)"World Weather Tokyo", YELLOW);
+	lcdDrawFillRect(dev, 0, fontHeight, SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLUE);
+
+	lcdSetFontFill(dev, BLACK);
+	lcdDrawString(dev, fx, 10, fontHeight*3-1, (uint8_t *)"05-15:Heavy Rain", CYAN);
+	lcdSetFontUnderLine(dev, RED);
+	lcdDrawString(dev, fx, 10, fontHeight*4-1, (uint8_t *)"Temp 21.5 18.2", WHITE);
+	lcdUnsetFontUnderLine(dev);
+	lcdUnsetFontFill(dev);
+
+	lcdDrawLine(dev, 0, 120, SCREEN_WIDTH-1, 120, WHITE);
+	lcdDrawLine(dev, 0, fontHeight, SCREEN_WIDTH-1, SCREEN_HEIGHT-1, RED);
+	lcdDrawRect(dev, 20, 130, 120, 200, YELLOW);
+	lcdDrawCircle(dev, 60, 165, 30, CYAN);
+	lcdDrawFillCircle(dev, 200, 170, 25, PURPLE);
+	lcdDrawRoundRect(dev, 130, 130, 190, 230, 10, WHITE);
+	lcdDrawFillArrow(dev, 290, 140, 290, 230, 10, RED);
+
+	uint16_t colors[200];
+	lcdBeginPixels(dev, 20, 205, 219, 234);
+	for(int y=0;y<30;y++) {
+		for(int x=0;x<200;x++) colors[x] = rgb565_conv(x, y*8, 255-x);
+		lcdPushPixels(dev, colors, 200);
+	}
+	lcdEndPixels(dev);
+}
+
+int main(int argc, char **argv)
+{
+	const char * mode = (argc > 1) ? argv[1] : "async";
+	const char * path = (argc > 2) ? argv[2] : "snapshot.png";
+
+	TFT_t dev;
+	memset(&dev, 0, sizeof(dev));
+	EMU_t * emu = emu_master_init(&dev, SCREEN_WIDTH, SCREEN_HEIGHT);
+	lcdInit(&dev, 0x9341, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0);
+
+	if (strcmp(mode, "direct") != 0) lcdSetAsync(&dev);
+	if (strcmp(mode, "fb") == 0) lcdSetFrameBuffer(&dev);
+	if (strcmp(mode, "dl") == 0) lcdSetDisplayList(&dev);
+	if (strcmp(mode, "task") == 0) lcdSetFlushTask(&dev, PRO_CPU_NUM);
+
+	FontxFile fx[2];
+	InitFontx(fx, FONT_DIR "/ILGH24XB.FNT", "");
+
+	emu_reset_stats(emu);
+#if LCD_STATS
+	lcdResetStats(&dev);
+#endif
+	draw(&dev, fx);
+	lcdFlush(&dev);
+	lcdFence(&dev);
+
+	EMU_STATS_t stats;
+	emu_get_stats(emu, &stats);
+	printf("mode=%s transactions=%"PRIu32" polling=%"PRIu32" interrupt=%"PRIu32" commands=%"PRIu32"\n",
+		mode, stats.transactions, stats.polling, stats.interrupt, stats.commands);
+	printf("bytes=%"PRIu64" pixels=%"PRIu64" errors=%"PRIu32" bus=%.3fms\n",
+		stats.bytes, stats.pixels, stats.errors, stats.bus_ns / 1e6);
+#if LCD_STATS
+	lcdDumpStats(&dev);
+#endif
+
+	size_t length = strlen(path);
+	bool ok;
+	if (length > 4 && strcmp(&path[length-4], ".ppm") == 0) {
+		ok = emu_save_ppm(emu, path);
+	} else {
+		ok = emu_save_png(emu, path);
+	}
+	if (!ok) {
+		fprintf(stderr, "cannot write %s\n", path);
+		return 1;
+	}
+	return stats.errors ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+/* Short transfers in async mode
+
+   usage: test_async
+
+   DMA buffers written by polling must not wait for a transaction that is
+   never queued. Every mode draws the same short writes, with the default
+   polling threshold and with every transfer polled, and has to finish
+   with the screen of the direct mode.
+   The exit status is 1 on a difference, and the test is aborted when it
+   hangs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+
+#include "ili9340.h"
+#include "fontx.h"
+#include "ili9340_emu.h"
+
+#define SCREEN_WIDTH  320
+#define SCREEN_HEIGHT 240
+
+static void row_source(void * arg, uint16_t row, uint16_t * colors, uint16_t width)
+{
+	(void)arg;
+	for(int i=0;i<width;i++) colors[i] = rgb565_conv(i * 32, row * 32, 128);
+}
+
+static void draw(TFT_t * dev, FontxFile * fx)
+{
+	uint16_t colors[4] = { RED, GREEN, BLUE, WHITE };
+	for(int i=0;i<3;i++) {
+		lcdDrawMultiPixels(dev, 10, 10 + i, 4, colors);
+	}
+	for(int i=0;i<3;i++) {
+		lcdDrawRowSource(dev, 20 + i * 8, 20, 4, 2, row_source, NULL);
+	}
+	lcdSetFontFill(dev, BLACK);
+	lcdDrawString(dev, fx, 10, 60, (uint8_t *)"21.5", YELLOW);
+	lcdUnsetFontFill(dev);
+	lcdDrawPixel(dev, 100, 100, CYAN);
+	lcdFlush(dev);
+	lcdDrawPixel(dev, 101, 100, CYAN);
+	lcdFlush(dev);
+	lcdFence(dev);
+}
+
+static uint16_t * render(const char * mode, uint16_t threshold, FontxFile * fx)
+{
+	TFT_t dev;
+	memset(&dev, 0, sizeof(dev));
+	EMU_t * emu = emu_master_init(&dev, SCREEN_WIDTH, SCREEN_HEIGHT);
+	lcdInit(&dev, 0x9341, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0);
+	lcdSetPollingThreshold(&dev, threshold);
+	if (strcmp(mode, "direct") != 0) lcdSetAsync(&dev);
+	if (strcmp(mode, "fb") == 0) lcdSetFrameBuffer(&dev);
+	if (strcmp(mode, "task") == 0) lcdSetFlushTask(&dev, PRO_CPU_NUM);
+	lcdFillScreen(&dev, GRAY);
+	draw(&dev, fx);
+	if (strcmp(mode, "task") == 0) lcdUnsetFlushTask(&dev);
+	if (strcmp(mode, "fb") == 0) lcdUnsetFrameBuffer(&dev);
+
+	EMU_STATS_t stats;
+	emu_get_stats(emu, &stats);
+	uint16_t * screen = NULL;
+	if (stats.errors == 0) {
+		screen = malloc(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t));
+		for(int y=0;y<SCREEN_HEIGHT;y++) {
+			for(int x=0;x<SCREEN_WIDTH;x++) screen[y * SCREEN_WIDTH + x] = emu_get_pixel(emu, x, y);
+		}
+	}
+	emu_master_deinit(&dev, emu);
+	return screen;
+}
+
+int main(void)
+{
+	static const char * modes[] = { "async", "fb", "task" };
+	static const uint16_t thresholds[] = { SPI_POLLING_THRESHOLD, SPI_BUFFER_SIZE };
+	FontxFile fx[2];
+	InitFontx(fx, FONT_DIR "/ILGH24XB.FNT", "");
+	alarm(30);
+
+	int failed = 0;
+	uint16_t * expected = render("direct", SPI_POLLING_THRESHOLD, fx);
+	for(size_t t=0;t<sizeof(thresholds)/sizeof(thresholds[0]);t++) {
+		for(size_t m=0;m<sizeof(modes)/sizeof(modes[0]);m++) {
+			uint16_t * screen = render(modes[m], thresholds[t], fx);
+			bool ok = expected && screen && memcmp(expected, screen, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t)) == 0;
+			printf("%-6s threshold=%-4d %s\n", modes[m], thresholds[t], ok ? "ok" : "FAILED");
+			if (!ok) failed++;
+			free(screen);
+		}
+	}
+	free(expected);
+	CloseFontx(fx);
+	return failed ? 1 : 0;
+}
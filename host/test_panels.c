@@ -0,0 +1,133 @@
+/* Two panels drawn at the same time
+
+   usage: test_panels
+
+   Each TFT_t keeps its own bus state, so two panels can be driven from
+   two threads. Every pair of modes draws a different screen on each of
+   two emulated panels in parallel, and each screen has to be the one the
+   panel shows when it is drawn alone.
+   The exit status is 1 on a difference, and the test is aborted when it
+   hangs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+
+#include "ili9340.h"
+#include "fontx.h"
+#include "ili9340_emu.h"
+
+#define SCREEN_WIDTH  320
+#define SCREEN_HEIGHT 240
+#define FRAMES 20
+
+typedef struct {
+	const char * mode;
+	int panel;		// Which screen is drawn
+	uint16_t * screen;
+} PANEL_t;
+
+static void draw(TFT_t * dev, FontxFile * fx, int panel, int frame)
+{
+	uint16_t back = panel ? BLUE : GRAY;
+	uint16_t color = panel ? YELLOW : CYAN;
+	char text[32];
+
+	lcdFillScreen(dev, back);
+	sprintf(text, "Panel %d frame %d", panel, frame);
+	lcdDrawString(dev, fx, 10, 40, (uint8_t *)text, color);
+	lcdSetFontFill(dev, BLACK);
+	lcdDrawString(dev, fx, 10, 80, (uint8_t *)"21.5 18.2", WHITE);
+	lcdUnsetFontFill(dev);
+	lcdDrawLine(dev, 0, 100, SCREEN_WIDTH-1, SCREEN_HEIGHT-1, RED);
+	lcdDrawFillCircle(dev, 100 + panel * 100, 170, 40, PURPLE);
+	lcdDrawRoundRect(dev, 220, 110, 300, 230, 10, color);
+	uint16_t colors[64];
+	for(int y=0;y<16;y++) {
+		for(int x=0;x<64;x++) colors[x] = rgb565_conv(x * 4, y * 16, panel * 255);
+		lcdDrawMultiPixels(dev, 10, 200 + y, 64, colors);
+	}
+	lcdFlush(dev);
+}
+
+static void * render(void * arg)
+{
+	PANEL_t * panel = arg;
+	TFT_t dev;
+	memset(&dev, 0, sizeof(dev));
+	EMU_t * emu = emu_master_init(&dev, SCREEN_WIDTH, SCREEN_HEIGHT);
+	lcdInit(&dev, 0x9341, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0);
+	if (strcmp(panel->mode, "direct") != 0) lcdSetAsync(&dev);
+	if (strcmp(panel->mode, "fb") == 0) lcdSetFrameBuffer(&dev);
+	if (strcmp(panel->mode, "dl") == 0) lcdSetDisplayList(&dev);
+	if (strcmp(panel->mode, "task") == 0) lcdSetFlushTask(&dev, PRO_CPU_NUM);
+
+	FontxFile fx[2];
+	InitFontx(fx, FONT_DIR "/ILGH24XB.FNT", "");
+	for(int frame=0;frame<FRAMES;frame++) draw(&dev, fx, panel->panel, frame);
+	lcdFence(&dev);
+	if (strcmp(panel->mode, "task") == 0) lcdUnsetFlushTask(&dev);
+	if (strcmp(panel->mode, "fb") == 0) lcdUnsetFrameBuffer(&dev);
+	if (strcmp(panel->mode, "dl") == 0) lcdUnsetDisplayList(&dev);
+	CloseFontx(fx);
+
+	EMU_STATS_t stats;
+	emu_get_stats(emu, &stats);
+	panel->screen = NULL;
+	if (stats.errors == 0) {
+		panel->screen = malloc(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t));
+		for(int y=0;y<SCREEN_HEIGHT;y++) {
+			for(int x=0;x<SCREEN_WIDTH;x++) panel->screen[y * SCREEN_WIDTH + x] = emu_get_pixel(emu, x, y);
+		}
+	}
+	emu_master_deinit(&dev, emu);
+	return NULL;
+}
+
+static bool same(const uint16_t * a, const uint16_t * b)
+{
+	return a && b && memcmp(a, b, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t)) == 0;
+}
+
+int main(void)
+{
+	static const char * pairs[][2] = {
+		{ "direct", "direct" },
+		{ "async", "async" },
+		{ "fb", "dl" },
+		{ "task", "async" },
+		{ "task", "task" },
+	};
+	alarm(60);
+
+	// Each screen drawn alone
+	PANEL_t alone[2] = {
+		{ .mode = "direct", .panel = 0 },
+		{ .mode = "direct", .panel = 1 },
+	};
+	render(&alone[0]);
+	render(&alone[1]);
+
+	int failed = 0;
+	for(size_t i=0;i<sizeof(pairs)/sizeof(pairs[0]);i++) {
+		PANEL_t panel[2] = {
+			{ .mode = pairs[i][0], .panel = 0 },
+			{ .mode = pairs[i][1], .panel = 1 },
+		};
+		pthread_t thread[2];
+		for(int p=0;p<2;p++) pthread_create(&thread[p], NULL, render, &panel[p]);
+		for(int p=0;p<2;p++) pthread_join(thread[p], NULL);
+		for(int p=0;p<2;p++) {
+			bool ok = same(alone[p].screen, panel[p].screen);
+			printf("%-6s + %-6s panel %d %s\n", pairs[i][0], pairs[i][1], p, ok ? "ok" : "FAILED");
+			if (!ok) failed++;
+			free(panel[p].screen);
+		}
+	}
+	free(alone[0].screen);
+	free(alone[1].screen);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+/* Generated by fixture.py from fonts/test.json. Do not edit. */
+#include "weather_fixture.h"
+
+const WEATHER_t weather_fixture_tokyo = {
+	.title = "Tokyo",
+	.woeid = 1118370,
+	.sun_set = "2020-01-16T16:51:05.516037+09:00",
+	.latt_long = "35.670479,139.740921",
+	.time = "2020-01-16T20:01:17.604499+09:00",
+	.timezone_name = "JST",
+	.timezone = "Asia/Tokyo",
+	.sun_rise = "2020-01-16T06:49:50.916354+09:00",
+	.location_type = "City",
+	.daily = {
+		{
+			.wind_speed = 3.083387197751796,
+			.applicable_date = "2020-01-16",
+			.predictability = 71,
+			.weather_state_abbr = "hc",
+			.weather_state_name = "Heavy Cloud",
+			.created = "2020-01-16T09:20:46.577077Z",
+			.wind_direction = 271.50000000000006,
+			.air_pressure = 1022.0,
+			.humidity = 46,
+			.visibility = 13.978677026167183,
+			.the_temp = 8.485,
+			.min_temp = 5.13,
+			.max_temp = 8.91,
+			.id = 2147483647,
+			.wind_direction_compass = "W",
+		},
+		{
+			.wind_speed = 7.062985440512738,
+			.applicable_date = "2020-01-17",
+			.predictability = 73,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Showers",
+			.created = "2020-01-16T09:20:49.636118Z",
+			.wind_direction = 7.500000000000001,
+			.air_pressure = 1018.5,
+			.humidity = 53,
+			.visibility = 13.485618985126859,
+			.the_temp = 8.665,
+			.min_temp = 4.505,
+			.max_temp = 9.280000000000001,
+			.id = 2147483647,
+			.wind_direction_compass = "N",
+		},
+		{
+			.wind_speed = 11.90217685748827,
+			.applicable_date = "2020-01-18",
+			.predictability = 85,
+			.weather_state_abbr = "sl",
+			.weather_state_name = "Sleet",
+			.created = "2020-01-16T09:20:52.554508Z",
+			.wind_direction = 358.5,
+			.air_pressure = 1012.0,
+			.humidity = 66,
+			.visibility = 5.6610022468782315,
+			.the_temp = 5.279999999999999,
+			.min_temp = 3.72,
+			.max_temp = 6.645,
+			.id = 2147483647,
+			.wind_direction_compass = "N",
+		},
+		{
+			.wind_speed = 3.474709953943636,
+			.applicable_date = "2020-01-19",
+			.predictability = 70,
+			.weather_state_abbr = "lc",
+			.weather_state_name = "Light Cloud",
+			.created = "2020-01-16T09:20:56.109998Z",
+			.wind_direction = 54.2195680337904,
+			.air_pressure = 1016.0,
+			.humidity = 55,
+			.visibility = 13.761507794480234,
+			.the_temp = 7.99,
+			.min_temp = 2.065,
+			.max_temp = 9.315000000000001,
+			.id = 2147483647,
+			.wind_direction_compass = "NE",
+		},
+		{
+			.wind_speed = 3.5180206833956364,
+			.applicable_date = "2020-01-20",
+			.predictability = 68,
+			.weather_state_abbr = "c",
+			.weather_state_name = "Clear",
+			.created = "2020-01-16T09:20:58.540038Z",
+			.wind_direction = 340.41477488094256,
+			.air_pressure = 1014.0,
+			.humidity = 50,
+			.visibility = 14.010677642567407,
+			.the_temp = 11.125,
+			.min_temp = 3.95,
+			.max_temp = 12.66,
+			.id = 2147483647,
+			.wind_direction_compass = "NNW",
+		},
+		{
+			.wind_speed = 6.369873339696174,
+			.applicable_date = "2020-01-21",
+			.predictability = 68,
+			.weather_state_abbr = "c",
+			.weather_state_name = "Clear",
+			.created = "2020-01-16T09:21:02.427318Z",
+			.wind_direction = 345.5,
+			.air_pressure = 1021.0,
+			.humidity = 40,
+			.visibility = 9.999726596675416,
+			.the_temp = 11.29,
+			.min_temp = 4.095000000000001,
+			.max_temp = 12.16,
+			.id = 2147483647,
+			.wind_direction_compass = "NNW",
+		},
+	},
+};
+
+const WEATHER_t weather_fixture_snow = {
+	.title = "Tokyo",
+	.woeid = 1118370,
+	.sun_set = "2020-01-16T16:51:05.516037+09:00",
+	.latt_long = "35.670479,139.740921",
+	.time = "2020-01-16T20:01:17.604499+09:00",
+	.timezone_name = "JST",
+	.timezone = "Asia/Tokyo",
+	.sun_rise = "2020-01-16T06:49:50.916354+09:00",
+	.location_type = "City",
+	.daily = {
+		{
+			.wind_speed = 3.083387197751796,
+			.applicable_date = "2020-01-16",
+			.predictability = 71,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Snow",
+			.created = "2020-01-16T09:20:46.577077Z",
+			.wind_direction = 271.50000000000006,
+			.air_pressure = 1022.0,
+			.humidity = 46,
+			.visibility = 13.978677026167183,
+			.the_temp = -8.485,
+			.min_temp = -5.13,
+			.max_temp = -8.91,
+			.id = 2147483647,
+			.wind_direction_compass = "W",
+		},
+		{
+			.wind_speed = 7.062985440512738,
+			.applicable_date = "2020-01-17",
+			.predictability = 73,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Snow",
+			.created = "2020-01-16T09:20:49.636118Z",
+			.wind_direction = 7.500000000000001,
+			.air_pressure = 1018.5,
+			.humidity = 53,
+			.visibility = 13.485618985126859,
+			.the_temp = -8.665,
+			.min_temp = -4.505,
+			.max_temp = -9.280000000000001,
+			.id = 2147483647,
+			.wind_direction_compass = "N",
+		},
+		{
+			.wind_speed = 11.90217685748827,
+			.applicable_date = "2020-01-18",
+			.predictability = 85,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Snow",
+			.created = "2020-01-16T09:20:52.554508Z",
+			.wind_direction = 358.5,
+			.air_pressure = 1012.0,
+			.humidity = 66,
+			.visibility = 5.6610022468782315,
+			.the_temp = -5.279999999999999,
+			.min_temp = -3.72,
+			.max_temp = -6.645,
+			.id = 2147483647,
+			.wind_direction_compass = "N",
+		},
+		{
+			.wind_speed = 3.474709953943636,
+			.applicable_date = "2020-01-19",
+			.predictability = 70,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Snow",
+			.created = "2020-01-16T09:20:56.109998Z",
+			.wind_direction = 54.2195680337904,
+			.air_pressure = 1016.0,
+			.humidity = 55,
+			.visibility = 13.761507794480234,
+			.the_temp = -7.99,
+			.min_temp = -2.065,
+			.max_temp = -9.315000000000001,
+			.id = 2147483647,
+			.wind_direction_compass = "NE",
+		},
+		{
+			.wind_speed = 3.5180206833956364,
+			.applicable_date = "2020-01-20",
+			.predictability = 68,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Snow",
+			.created = "2020-01-16T09:20:58.540038Z",
+			.wind_direction = 340.41477488094256,
+			.air_pressure = 1014.0,
+			.humidity = 50,
+			.visibility = 14.010677642567407,
+			.the_temp = -11.125,
+			.min_temp = -3.95,
+			.max_temp = -12.66,
+			.id = 2147483647,
+			.wind_direction_compass = "NNW",
+		},
+		{
+			.wind_speed = 6.369873339696174,
+			.applicable_date = "2020-01-21",
+			.predictability = 68,
+			.weather_state_abbr = "s",
+			.weather_state_name = "Snow",
+			.created = "2020-01-16T09:21:02.427318Z",
+			.wind_direction = 345.5,
+			.air_pressure = 1021.0,
+			.humidity = 40,
+			.visibility = 9.999726596675416,
+			.the_temp = -11.29,
+			.min_temp = -4.095000000000001,
+			.max_temp = -12.16,
+			.id = 2147483647,
+			.wind_direction_compass = "NNW",
+		},
+	},
+};
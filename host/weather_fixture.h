@@ -0,0 +1,11 @@
+#ifndef _WEATHER_FIXTURE_H_
+#define _WEATHER_FIXTURE_H_
+
+#include "view.h"
+
+// Recorded from fonts/test.json
+extern const WEATHER_t weather_fixture_tokyo;
+// The same days with snow and negative temperatures
+extern const WEATHER_t weather_fixture_snow;
+
+#endif /* _WEATHER_FIXTURE_H_ */
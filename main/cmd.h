@@ -5,6 +5,7 @@
 #define CMD_VIEW5       500
 #define CMD_VIEW6       600
 #define CMD_UPDATE      700
+#define CMD_STATS       800
 
 typedef struct {
     uint16_t command;
@@ -6,3 +6,12 @@
 # embed files from the "certs" directory as binary data symbols
 # in the app
 COMPONENT_EMBED_TXTFILES := metaweather_com_root_cert.pem
+
+# link the font selected in menuconfig into the app (CONFIG_ESP_FONT_EMBEDDED)
+ifdef CONFIG_ESP_FONT_EMBEDDED
+ifdef CONFIG_ESP_FONT_MINCYO
+COMPONENT_EMBED_FILES := ../fonts/ILMH24XB.FNT
+else
+COMPONENT_EMBED_FILES := ../fonts/ILGH24XB.FNT
+endif
+endif
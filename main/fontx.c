@@ -1,5 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 #include "esp_err.h"
@@ -10,6 +12,37 @@
 
 #define FontxDebug 0 // for Debug
 
+// RAM for the ANK glyphs of each font file (bytes, 0:no cache)
+// When the 128 glyphs fit, they are all read at OpenFontx.
+// Otherwise the least recently used glyph is replaced.
+#ifdef CONFIG_ESP_FONT_CACHE_SIZE
+#define FontxCacheSize CONFIG_ESP_FONT_CACHE_SIZE
+#else
+#define FontxCacheSize 8192
+#endif
+#define FontxCacheCodes 0x80
+
+// ANKグリフのキャッシュ
+struct FONTX_CACHE {
+	uint8_t slots;				// Number of glyphs in glyphs[]
+	uint32_t clock;
+	uint8_t slot[FontxCacheCodes];		// Slot+1 of each code, 0:not cached
+	uint8_t code[FontxCacheCodes];		// Code in each slot
+	uint32_t used[FontxCacheCodes];		// Last use of each slot
+	uint8_t glyphs[];
+};
+
+// Kanjiフォントのコードブロック
+struct FONTX_BLOCK {
+	uint16_t start;		// First SJIS code
+	uint16_t end;		// Last SJIS code
+	uint32_t glyph;		// Number of the glyph of start in the file
+};
+
+extern const uint8_t Utf8SjisIndex[256];
+extern const FontxSjisPage Utf8SjisPages[];
+extern const uint16_t Utf8SjisCodes[];
+
 // フォントファイルパスを構造体に保存
 void AddFontx(FontxFile *fx, const char *path)
 {
@@ -25,27 +58,166 @@ void InitFontx(FontxFile *fxs, const char *f0, const char *f1)
 	AddFontx(&fxs[1], f1);
 }
 
+// メモリ上のフォントで初期化
+// data:FONTX file linked into the application (memory mapped flash)
+// Glyphs are read from data without any file I/O.
+void InitFontxMemory(FontxFile *fxs, const uint8_t *data, size_t size)
+{
+	AddFontx(&fxs[0], "(memory)");
+	fxs[0].data = data;
+	fxs[0].size = size;
+	AddFontx(&fxs[1], "");
+}
+
+// ANKグリフのキャッシュを作る
+static void OpenFontxCache(FontxFile *fx)
+{
+	int slots = FontxCacheSize / fx->fsz;
+	if (slots > FontxCacheCodes) slots = FontxCacheCodes;
+	if (slots == 0) return;
+	struct FONTX_CACHE *cache = calloc(1, sizeof(struct FONTX_CACHE) + slots * fx->fsz);
+	if (cache == NULL) {
+		printf("Fontx:%s no memory for the cache.\n",fx->path);
+		return;
+	}
+	cache->slots = slots;
+	if (slots == FontxCacheCodes) {
+		// The whole table is read now and the file is not read again
+		if (fseek(fx->file, 17, SEEK_SET) || fread(cache->glyphs, fx->fsz, slots, fx->file) != (size_t)slots) {
+			printf("Fontx:%s cannot preload.\n",fx->path);
+			free(cache);
+			return;
+		}
+		for(int code=0;code<slots;code++) {
+			cache->slot[code] = code + 1;
+			cache->code[code] = code;
+		}
+	}
+	fx->cache = cache;
+}
+
+// キャッシュからグリフを取り出す
+static const uint8_t *GetFontxCache(FontxFile *fx, uint8_t ascii)
+{
+	struct FONTX_CACHE *cache = fx->cache;
+	if (cache == NULL || cache->slot[ascii] == 0) {
+		fx->misses++;
+		return NULL;
+	}
+	int slot = cache->slot[ascii] - 1;
+	cache->used[slot] = ++cache->clock;
+	fx->hits++;
+	return &cache->glyphs[slot * fx->fsz];
+}
+
+// ファイルから読んだグリフをキャッシュに入れる
+static void PutFontxCache(FontxFile *fx, uint8_t ascii, uint8_t *pGlyph)
+{
+	struct FONTX_CACHE *cache = fx->cache;
+	if (cache == NULL) return;
+	int slot = 0;
+	for(int i=1;i<cache->slots;i++) {
+		if (cache->used[i] < cache->used[slot]) slot = i;
+	}
+	if (cache->used[slot]) cache->slot[cache->code[slot]] = 0;
+	cache->slot[ascii] = slot + 1;
+	cache->code[slot] = ascii;
+	cache->used[slot] = ++cache->clock;
+	memcpy(&cache->glyphs[slot * fx->fsz], pGlyph, fx->fsz);
+}
+
+static int CompareFontxBlock(const void *a, const void *b)
+{
+	return ((const struct FONTX_BLOCK *)a)->start - ((const struct FONTX_BLOCK *)b)->start;
+}
+
+// Kanjiフォントのコードブロックの索引を作る
+// The block table is read once and sorted, so a code is found
+// by binary search without reading the file.
+static bool OpenFontxIndex(FontxFile *fx)
+{
+	size_t length = fx->bc * 4;
+	if (length == 0) return false;
+	uint8_t *table = malloc(length);
+	struct FONTX_BLOCK *blocks = malloc(fx->bc * sizeof(struct FONTX_BLOCK));
+	if (table == NULL || blocks == NULL) goto fail;
+	if (fx->data) {
+		if (fx->size < 18 + length) goto fail;
+		memcpy(table, &fx->data[18], length);
+	} else {
+		if (fseek(fx->file, 18, SEEK_SET) || fread(table, 1, length, fx->file) != length) goto fail;
+	}
+
+	uint32_t glyph = 0;
+	for(int i=0;i<fx->bc;i++) {
+		blocks[i].start = table[i*4] | (table[i*4+1] << 8);
+		blocks[i].end = table[i*4+2] | (table[i*4+3] << 8);
+		blocks[i].glyph = glyph;
+		if (blocks[i].end < blocks[i].start) goto fail;
+		glyph += blocks[i].end - blocks[i].start + 1;
+	}
+	qsort(blocks, fx->bc, sizeof(struct FONTX_BLOCK), CompareFontxBlock);
+	free(table);
+	fx->blocks = blocks;
+	return true;
+
+fail:
+	free(table);
+	free(blocks);
+	return false;
+}
+
+// SJISコードのグリフ番号を返す (-1:not in the font)
+static int32_t FindFontxGlyph(FontxFile *fx, uint16_t sjis)
+{
+	int lo = 0;
+	int hi = fx->bc - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		struct FONTX_BLOCK *block = &fx->blocks[mid];
+		if (sjis < block->start) {
+			hi = mid - 1;
+		} else if (sjis > block->end) {
+			lo = mid + 1;
+		} else {
+			return block->glyph + (sjis - block->start);
+		}
+	}
+	return -1;
+}
+
 // フォントファイルをOPEN
 bool OpenFontx(FontxFile *fx)
 {
 	FILE *f;
 	if(!fx->opened){
-		if(FontxDebug)printf("[openFont]fx->path=[%s]\n",fx->path);
-		f = fopen(fx->path, "r");
-		if(FontxDebug)printf("[openFont]fopen=%p\n",f);
-		if (f == NULL) {
-			fx->valid = false;
-			printf("Fontx:%s not found.\n",fx->path);
-			return fx->valid ;
-		}
-		fx->opened = true;
-		fx->file = f;
 		char buf[18];
-		if (fread(buf, 1, sizeof(buf), fx->file) != sizeof(buf)) {
-			fx->valid = false;
-			printf("Fontx:%s not FONTX format.\n",fx->path);
-			fclose(fx->file);
-			return fx->valid ;
+		if(fx->data){
+			// Font linked into the application
+			if(fx->size < sizeof(buf)){
+				fx->valid = false;
+				printf("Fontx:%s not FONTX format.\n",fx->path);
+				return fx->valid ;
+			}
+			fx->opened = true;
+			memcpy(buf, fx->data, sizeof(buf));
+		} else {
+			if(FontxDebug)printf("[openFont]fx->path=[%s]\n",fx->path);
+			f = fopen(fx->path, "r");
+			if(FontxDebug)printf("[openFont]fopen=%p\n",f);
+			if (f == NULL) {
+				fx->valid = false;
+				printf("Fontx:%s not found.\n",fx->path);
+				return fx->valid ;
+			}
+			fx->opened = true;
+			fx->file = f;
+			if (fread(buf, 1, sizeof(buf), fx->file) != sizeof(buf)) {
+				fx->valid = false;
+				printf("Fontx:%s not FONTX format.\n",fx->path);
+				fclose(fx->file);
+				return fx->valid ;
+			}
 		}
 
 		if(FontxDebug) {
@@ -62,10 +234,18 @@ bool OpenFontx(FontxFile *fx)
 		if(fx->fsz > FontxGlyphBufSize){
 			printf("Fontx:%s is too big font size.\n",fx->path);
 			fx->valid = false;
-			fclose(fx->file);
+			if(fx->file) fclose(fx->file);
+			return fx->valid ;
+		}
+		if(!fx->is_ank && !OpenFontxIndex(fx)){
+			printf("Fontx:%s bad code block table.\n",fx->path);
+			fx->valid = false;
+			if(fx->file) fclose(fx->file);
 			return fx->valid ;
 		}
 		fx->valid = true;
+		// A font in memory needs no cache
+		if (fx->is_ank && fx->file) OpenFontxCache(fx);
 	}
 	return fx->valid;
 }
@@ -74,9 +254,14 @@ bool OpenFontx(FontxFile *fx)
 void CloseFontx(FontxFile *fx)
 {
 	if(fx->opened){
-		fclose(fx->file);
+		if(fx->file) fclose(fx->file);
+		fx->file = NULL;
 		fx->opened = false;
 	}
+	free(fx->cache);
+	fx->cache = NULL;
+	free(fx->blocks);
+	fx->blocks = NULL;
 }
 
 // フォント構造体の表示
@@ -92,6 +277,7 @@ void DumpFontx(FontxFile *fxs)
 		printf("fxs[%d]->h=%d\n",i,fxs[i].h);
 		printf("fxs[%d]->fsz=%d\n",i,fxs[i].fsz);
 		printf("fxs[%d]->bc=%d\n",i,fxs[i].bc);
+		printf("fxs[%d]->hits=%"PRIu32" misses=%"PRIu32"\n",i,fxs[i].hits,fxs[i].misses);
 	}
 }
 
@@ -195,75 +381,74 @@ uint8_t getFortHeight(FontxFile *fx) {
 
 */
 
-bool GetFontx(FontxFile *fxs, uint8_t ascii , uint8_t *pGlyph, uint8_t *pw, uint8_t *ph)
+// グリフの場所を返す
+// code:ASCII or SJIS code. Codes below 0x100 are read from the ANK font,
+// the others from the Kanji font.
+// A font in memory or a cached glyph is not copied. Otherwise the glyph
+// is read into pGlyph. The pointer is valid until the next call.
+// Returns NULL when the fonts have no glyph for code.
+const uint8_t *GetFontxGlyph(FontxFile *fxs, uint16_t code , uint8_t *pGlyph, uint8_t *pw, uint8_t *ph)
 {
   
 	int i;
 	uint32_t offset;
 
-	if(FontxDebug)printf("[GetFontx]ascii=0x%x\n",ascii);
+	if(FontxDebug)printf("[GetFontx]code=0x%x\n",code);
 	for(i=0; i<2; i++){
-	//for(i=0; i<1; i++){
 		if(!OpenFontx(&fxs[i])) continue;
 		if(FontxDebug)printf("[GetFontx]openFontxFile[%d] ok\n",i);
 	
-		//if(ascii < 0x100){
-		if(ascii < 0x80){
-			if(fxs[i].is_ank){
+		if(code < 0x100){
+			if(!fxs[i].is_ank) continue;
 if(FontxDebug)printf("[GetFontx]fxs.is_ank fxs.fsz=%d\n",fxs[i].fsz);
-				offset = 17 + ascii * fxs[i].fsz;
-if(FontxDebug)printf("[GetFontx]offset=%d\n",offset);
-				if(fseek(fxs[i].file, offset, SEEK_SET)) {
-					printf("Fontx:seek(%u) failed.\n",offset);
-					return false;
+			if(code < FontxCacheCodes && !fxs[i].data) {
+				const uint8_t *glyph = GetFontxCache(&fxs[i], code);
+				if(glyph) {
+					if(pw) *pw = fxs[i].w;
+					if(ph) *ph = fxs[i].h;
+					return glyph;
 				}
-				if(fread(pGlyph, 1, fxs[i].fsz, fxs[i].file) != fxs[i].fsz) {
-					printf("Fontx:fread failed.\n");
-					return false;
-				}
-				if(pw) *pw = fxs[i].w;
-				if(ph) *ph = fxs[i].h;
-				return true;
 			}
-
+			offset = 17 + code * fxs[i].fsz;
 		} else {
-#if 0
-			if(!fxs[i].is_ank){
-				offset = 18;
-				if(fseek(fxs[i].file, offset, SEEK_SET)) {
-					printf("Fontx:seek(%u) failed.\n",offset);
-					return false;
-				}
-				uint16_t buf[2], nc = 0, bc = fxs[i].bc;
-
-				while(bc--){ 
-					if(fread((char *)buf, 1, 4, fxs[i].file) != 4) {
-						printf("Fontx:fread failed.\n");
-						return false;
-					}
-if(FontxDebug)printf("[GetFontx]buf=0x%x-0x%x\n",buf[0],buf[1]);
-					if(sjis >= buf[0] && sjis <= buf[1]) {
-						nc += sjis - buf[0];
-						offset = 18 + fxs[i].bc * 4 + nc * fxs[i].fsz;
-						if(fseek(fxs[i].file, offset, SEEK_SET)) {
-							printf("Fontx:seek(%u) failed.\n",offset);
-							return false;
-						}
-						if(fread(pGlyph, 1, fxs[i].fsz, fxs[i].file) != fxs[i].fsz) {
-							printf("Fontx:fread failed.\n");
-							return false;
-						}
-						if(pw) *pw = fxs[i].w;
-						if(ph) *ph = fxs[i].h;
-						return true;
-					}
-					nc += buf[1] - buf[0] + 1;
-				}
-			}
-#endif
+			if(fxs[i].is_ank) continue;
+			int32_t glyph = FindFontxGlyph(&fxs[i], code);
+if(FontxDebug)printf("[GetFontx]sjis=0x%x glyph=%"PRId32"\n",code,glyph);
+			if(glyph < 0) continue;
+			offset = 18 + fxs[i].bc * 4 + glyph * fxs[i].fsz;
+		}
+if(FontxDebug)printf("[GetFontx]offset=%"PRIu32"\n",offset);
+
+		if(pw) *pw = fxs[i].w;
+		if(ph) *ph = fxs[i].h;
+		if(fxs[i].data) {
+			if(offset + fxs[i].fsz > fxs[i].size) return NULL;
+			fxs[i].hits++;
+			return &fxs[i].data[offset];
+		}
+		if(fseek(fxs[i].file, offset, SEEK_SET)) {
+			printf("Fontx:seek(%"PRIu32") failed.\n",offset);
+			return NULL;
 		}
+		if(fread(pGlyph, 1, fxs[i].fsz, fxs[i].file) != fxs[i].fsz) {
+			printf("Fontx:fread failed.\n");
+			return NULL;
+		}
+		if(code < FontxCacheCodes) PutFontxCache(&fxs[i], code, pGlyph);
+		return pGlyph;
 	}
-	return false;
+	return NULL;
+}
+
+bool GetFontx(FontxFile *fxs, uint16_t code , uint8_t *pGlyph, uint8_t *pw, uint8_t *ph)
+{
+	uint8_t w, h;
+	const uint8_t *glyph = GetFontxGlyph(fxs, code, pGlyph, &w, &h);
+	if(glyph == NULL) return false;
+	if(glyph != pGlyph) memcpy(pGlyph, glyph, (w + 7)/8 * h);
+	if(pw) *pw = w;
+	if(ph) *ph = h;
+	return true;
 }
 
 
@@ -516,104 +701,76 @@ uint8_t RotateByte(uint8_t ch1) {
 }
 
 
-#if 0
-// UTF code(3Byte) を SJIS Code(2 Byte) に変換
-// https://www.mgo-tec.com/blog-entry-utf8sjis01.html
-uint16_t UTF2SJIS(spiffs_file fd, uint8_t *utf8) {
-
-  uint32_t offset = 0;
-  uint32_t ret;
-  uint32_t UTF8uint = utf8[0]*256*256 + utf8[1]*256 + utf8[2];
-   
-  if(utf8[0]>=0xC2 && utf8[0]<=0xD1){ //0xB0からS_JISコード実データ。0x00-0xAFまではライセンス文ヘッダなのでそれをカット。
-    offset = ((utf8[0]*256 + utf8[1])-0xC2A2)*2 + 0xB0; //文字"￠" UTF8コード C2A2～、S_jisコード8191
-  }else if(utf8[0]==0xE2 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE28090)*2 + 0x1EEC; //文字"‐" UTF8コード E28090～、S_jisコード815D
-  }else if(utf8[0]==0xE3 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE38080)*2 + 0x9DCC; //スペース UTF8コード E38080～、S_jisコード8140
-  }else if(utf8[0]==0xE4 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE4B880)*2 + 0x11CCC; //文字"一" UTF8コード E4B880～、S_jisコード88EA
-  }else if(utf8[0]==0xE5 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE58085)*2 + 0x12BCC; //文字"倅" UTF8コード E58085～、S_jisコード98E4
-  }else if(utf8[0]==0xE6 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE6808E)*2 + 0x1AAC2; //文字"怎" UTF8コード E6808E～、S_jisコード9C83
-  }else if(utf8[0]==0xE7 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE78081)*2 + 0x229A6; //文字"瀁" UTF8コード E78081～、S_jisコードE066
-  }else if(utf8[0]==0xE8 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE88080)*2 + 0x2A8A4; //文字"耀" UTF8コード E88080～、S_jisコード9773
-  }else if(utf8[0]==0xE9 && utf8[1]>=0x80){
-    offset = (UTF8uint-0xE98080)*2 + 0x327A4; //文字"退" UTF8コード E98080～、S_jisコード91DE
-  }else if(utf8[0]>=0xEF && utf8[1]>=0xBC){
-    offset = (UTF8uint-0xEFBC81)*2 + 0x3A6A4; //文字"！" UTF8コード EFBC81～、S_jisコード8149
-    if(utf8[0]==0xEF && utf8[1]==0xBD && utf8[2]==0x9E){
-      offset = 0x3A8DE; // "～" UTF8コード EFBD9E、S_jisコード8160
-    }
-  }
-
-if(FontxDebug)printf("[UTF2SJIS] offset=%d\n",offset);
-  char buf[2];
-  ret = SPIFFS_lseek(&fs, fd, offset, SPIFFS_SEEK_SET);
-if(FontxDebug)printf("[UTF2SJIS] lseek ret=%d\n",ret);
-  if (ret != offset) {
-    printf("UTF2SJIS:seek(%u) failed.\n",offset);
-    return 0;
-  }
-  if (SPIFFS_read(&fs, fd, buf, sizeof(buf)) != sizeof(buf)) {
-    printf("UTF2SJIS:read failed.\n");
-    return 0;
-  }
-if(FontxDebug)printf("[UTF2SJIS] sjis=0x%x%x\n",buf[0],buf[1]);
-  return buf[0]*256+buf[1];
+// UnicodeをSJISに変換 (0:no such character)
+static uint16_t Unicode2SJIS(uint32_t unicode)
+{
+	if (unicode < 0x80) return unicode;
+	if (unicode > 0xFFFF) return 0;
+	int page = Utf8SjisIndex[unicode >> 8];
+	if (page == 0) return 0;
+	const FontxSjisPage *p = &Utf8SjisPages[page - 1];
+	int low = unicode & 0xFF;
+	uint32_t bits = p->bits[low / 32];
+	uint32_t bit = 1UL << (low % 32);
+	if ((bits & bit) == 0) return 0;
+	return Utf8SjisCodes[p->base + p->rank[low / 32] + __builtin_popcount(bits & (bit - 1))];
 }
 
+// UTF8の1文字をSJISに変換
+// len:Receives the number of bytes used (1 or more)
+static uint16_t Utf8ToSJIS(const uint8_t *utf8, size_t stlen, int *len)
+{
+	uint8_t c = utf8[0];
+	uint32_t unicode;
+	int n;
+	*len = 1;
+	if (c < 0x80) return c;
+	if ((c & 0xE0) == 0xC0) {
+		n = 2;
+		unicode = c & 0x1F;
+	} else if ((c & 0xF0) == 0xE0) {
+		n = 3;
+		unicode = c & 0x0F;
+	} else if ((c & 0xF8) == 0xF0) {
+		n = 4;
+		unicode = c & 0x07;
+	} else {
+		return 0;	// Not the first byte of a character
+	}
+	for(int i=1;i<n;i++) {
+		if ((size_t)i >= stlen || (utf8[i] & 0xC0) != 0x80) {
+			*len = i;
+			return 0;
+		}
+		unicode = (unicode << 6) | (utf8[i] & 0x3F);
+	}
+	*len = n;
+	return Unicode2SJIS(unicode);
+}
+
+// UTF8の1文字をSJISに変換
+// Returns 0 when SJIS has no such character.
+uint16_t UTF2SJIS(uint8_t *utf8)
+{
+	int len;
+	return Utf8ToSJIS(utf8, 4, &len);
+}
 
 // UTFを含む文字列をSJISに変換
-int String2SJIS(spiffs_file fd, unsigned char *str_in, size_t stlen,
-		uint16_t *sjis, size_t ssize) {
-  int i;
-  uint8_t sp;
-  uint8_t c1 = 0;
-  uint8_t c2 = 0;
-  uint8_t utf8[3];
-  uint16_t sjis2;
-  int spos = 0;
-
-  for(i=0;i<stlen;i++) {
-    sp = str_in[i];
-if(FontxDebug)printf("[String2SJIS]sp[%d]=%x\n",i,sp);
-    if ((sp & 0xf0) == 0xe0) { // 上位4ビットが1110なら、3バイト文字の1バイト目
-      c1 = sp;
-    } else if ((sp & 0xc0) == 0x80) { // 上位2ビットが10なら、他バイト文字の2バイト目以降
-      if (c2 == 0) {
-        c2 = sp;
-      } else {
-        if (c1 == 0xef && c2 == 0xbd) {
-if(FontxDebug)printf("[String2SJIS]hankaku kana %x-%x-%x\n",c1,c2,sp);
-          sjis2 = sp;
-if(FontxDebug)printf("[String2SJIS]sjis2=%x\n",sjis2);
-          if (spos < ssize) sjis[spos++] = sjis2;
-        } else if (c1 == 0xef && c2 == 0xbe) {
-if(FontxDebug)printf("[String2SJIS]hankaku kana %x-%x-%x\n",c1,c2,sp);
-          sjis2 = 0xc0 + (sp - 0x80);
-if(FontxDebug)printf("[String2SJIS]sjis2=%x\n",sjis2);
-          if (spos < ssize) sjis[spos++] = sjis2;
-        } else {
-if(FontxDebug)printf("[String2SJIS]UTF8 %x-%x-%x\n",c1,c2,sp);
-          utf8[0] = c1;
-          utf8[1] = c2;
-          utf8[2] = sp;
-          sjis2 = UTF2SJIS(fd, utf8);
-if(FontxDebug)printf("[String2SJIS]sjis2=%x\n",sjis2);
-          if (spos < ssize) sjis[spos++] = sjis2;
-        }
-        c1 = c2 = 0;
-      }
-    } else if ((sp & 0x80) == 0) { // 1バイト文字の場合
-if(FontxDebug)printf("[String2SJIS]ANK %x\n",sp);
-        if (spos < ssize) sjis[spos++] = sp;
-    }
-  }
-  return spos;
+// Characters that SJIS does not have become '?'.
+// Returns the number of codes in sjis.
+int String2SJIS(unsigned char *str_in, size_t stlen, uint16_t *sjis, size_t ssize)
+{
+	int spos = 0;
+	size_t i = 0;
+	while (i < stlen && (size_t)spos < ssize) {
+		int len;
+		uint16_t code = Utf8ToSJIS(&str_in[i], stlen - i, &len);
+if(FontxDebug)printf("[String2SJIS]str_in[%d]=%x sjis=%x\n",(int)i,str_in[i],code);
+		sjis[spos++] = code ? code : '?';
+		i += len;
+	}
+	return spos;
 }
-#endif
+
 
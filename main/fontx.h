@@ -2,6 +2,9 @@
 #define MAIN_FONTX_H_
 #define FontxGlyphBufSize (32*32/8)
 
+struct FONTX_CACHE;
+struct FONTX_BLOCK;
+
 typedef struct {
 	const char *path;
 	char  fxname[10];
@@ -13,16 +16,24 @@ typedef struct {
 	uint16_t fsz;
 	uint8_t bc;
 	FILE *file;
+	const uint8_t *data;
+	size_t size;
+	struct FONTX_CACHE *cache;
+	struct FONTX_BLOCK *blocks;	// Code blocks of a Kanji font, sorted
+	uint32_t hits;
+	uint32_t misses;
 } FontxFile;
 
 void AaddFontx(FontxFile *fx, const char *path);
 void InitFontx(FontxFile *fxs, const char *f0, const char *f1);
+void InitFontxMemory(FontxFile *fxs, const uint8_t *data, size_t size);
 bool OpenFontx(FontxFile *fx);
 void CloseFontx(FontxFile *fx);
 void DumpFontx(FontxFile *fxs);
 uint8_t getFortWidth(FontxFile *fx);
 uint8_t getFortHeight(FontxFile *fx);
-bool GetFontx(FontxFile *fxs, uint8_t ascii , uint8_t *pGlyph, uint8_t *pw, uint8_t *ph);
+bool GetFontx(FontxFile *fxs, uint16_t code , uint8_t *pGlyph, uint8_t *pw, uint8_t *ph);
+const uint8_t *GetFontxGlyph(FontxFile *fxs, uint16_t code , uint8_t *pGlyph, uint8_t *pw, uint8_t *ph);
 void Font2Bitmap(uint8_t *fonts, uint8_t *line, uint8_t w, uint8_t h, uint8_t inverse);
 void UnderlineBitmap(uint8_t *line, uint8_t w, uint8_t h);
 void ReversBitmap(uint8_t *line, uint8_t w, uint8_t h);
@@ -31,9 +42,14 @@ void ShowBitmap(uint8_t *bitmap, uint8_t pw, uint8_t ph);
 uint8_t RotateByte(uint8_t ch);
 
 // UTF8 to SJIS table
-// https://www.mgo-tec.com/blog-entry-utf8sjis01.html
-//#define Utf8Sjis "Utf8Sjis.tbl"
-//uint16_t UTF2SJIS(spiffs_file fd, uint8_t *utf8);
-//int String2SJIS(spiffs_file fd, unsigned char *str_in, size_t stlen, uint16_t *sjis, size_t ssize);
+// Generated into utf8sjis.c by utf8sjis.py
+typedef struct {
+	uint16_t base;		// First code of the page in Utf8SjisCodes
+	uint8_t rank[8];	// Bits set before each word of bits
+	uint32_t bits[8];	// Low bytes of the code points in the page
+} FontxSjisPage;
+
+uint16_t UTF2SJIS(uint8_t *utf8);
+int String2SJIS(unsigned char *str_in, size_t stlen, uint16_t *sjis, size_t ssize);
 #endif /* MAIN_FONTX_H_ */
 
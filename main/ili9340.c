@@ -1,181 +1,552 @@
 #include <string.h>
-#include <math.h>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-#include <driver/spi_master.h>
-#include <driver/gpio.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 
 #include "ili9340.h"
 
+#if LCD_STATS
+#include <inttypes.h>
+#ifdef ESP_PLATFORM
+#include "esp_idf_version.h"
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+#include "hal/cpu_hal.h"
+#define esp_cpu_get_cycle_count() cpu_hal_get_cycle_count()
+#else
+#include "esp_cpu.h"
+#endif
+#else
+#include "esp_cpu.h"
+#endif
+#endif
+
 #define TAG "ILI9340"
 #define	_DEBUG_ 0
 
-static const int GPIO_MOSI = 23;
-static const int GPIO_SCLK = 18;
+// Panel model
+// When the model is chosen at build time, by Kconfig or by defining
+// LCD_MODEL, lcdModel() is a constant and
+// the compiler drops the code of every other panel. Otherwise it is the
+// model given to lcdInit.
+#if CONFIG_ESP_LCD_MODEL_ILI9340
+#define LCD_MODEL 0x9340
+#elif CONFIG_ESP_LCD_MODEL_ILI9341
+#define LCD_MODEL 0x9341
+#elif CONFIG_ESP_LCD_MODEL_ST7735
+#define LCD_MODEL 0x7735
+#elif CONFIG_ESP_LCD_MODEL_ILI9225
+#define LCD_MODEL 0x9225
+#elif CONFIG_ESP_LCD_MODEL_ILI9226
+#define LCD_MODEL 0x9226
+#endif
+
+#ifdef LCD_MODEL
+#define lcdModel(dev) (LCD_MODEL)
+#else
+#define lcdModel(dev) ((dev)->_model)
+#endif
+
+// Statistics
+// Without LCD_STATS these macros are empty and nothing is counted.
+#if LCD_STATS
+typedef struct {
+	LCD_CALL_STATS_t * call;
+	uint32_t start;
+} LCD_STATS_SCOPE_t;
+
+static inline void lcdStatsScopeEnd(LCD_STATS_SCOPE_t * scope) {
+	scope->call->count++;
+	scope->call->cycles += (uint32_t)(esp_cpu_get_cycle_count() - scope->start);
+}
+
+// Count a call of the enclosing function, and its cycles up to the return
+#define LCD_STATS_CALL(dev, name) \
+	LCD_STATS_SCOPE_t _stats_scope __attribute__((cleanup(lcdStatsScopeEnd))) = { &(dev)->_stats.name, esp_cpu_get_cycle_count() }
+#define LCD_STATS_ADD(dev, name, n)	((dev)->_stats.name += (n))
+// Time spent waiting for the transport between BEGIN and END
+#define LCD_STATS_WAIT_BEGIN()		uint32_t _stats_wait = esp_cpu_get_cycle_count()
+#define LCD_STATS_WAIT_END(dev)		((dev)->_stats.blocked_cycles += (uint32_t)(esp_cpu_get_cycle_count() - _stats_wait))
+#else
+#define LCD_STATS_CALL(dev, name)
+#define LCD_STATS_ADD(dev, name, n)	((void)0)
+#define LCD_STATS_WAIT_BEGIN()
+#define LCD_STATS_WAIT_END(dev)		((void)0)
+#endif
 
 static const int SPI_Command_Mode = 0;
 static const int SPI_Data_Mode = 1;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_20M;
-////static const int SPI_Frequency = SPI_MASTER_FREQ_26M;
-static const int SPI_Frequency = SPI_MASTER_FREQ_40M;
-////static const int SPI_Frequency = SPI_MASTER_FREQ_80M;
 
+// Attach a panel behind any transport
+// The transport functions are called with ctx.
+void lcdInitTransport(TFT_t * dev, const LCD_TRANSPORT_t * transport, void * ctx)
+{
+	dev->_transport = transport;
+	dev->_transport_ctx = ctx;
+
+	// Transaction ring and DMA buffers for the async mode
+	dev->_async = false;
+	dev->_trans_queued = 0;
+	dev->_trans_done = 0;
+	for(int i=0;i<SPI_BUFFER_COUNT;i++) {
+		dev->_buffer[i] = heap_caps_malloc(SPI_BUFFER_SIZE, MALLOC_CAP_DMA);
+		assert(dev->_buffer[i] != NULL);
+		dev->_buffer_seq[i] = 0;
+	}
+	dev->_buffer_index = 0;
+
+	// Color-replicated buffer for rectangle fills
+	dev->_fill = heap_caps_malloc(SPI_FILL_PIXELS * 2, MALLOC_CAP_DMA);
+	assert(dev->_fill != NULL);
+	dev->_fill_valid = false;
+	dev->_fill_seq = 0;
+
+	dev->_polling_threshold = SPI_POLLING_THRESHOLD;
+	dev->_bulk_seq = 0;
+	dev->_polling_count = 0;
+	dev->_interrupt_count = 0;
+
+	// Address window cache
+	dev->_window_valid = false;
+	dev->_ram_write = false;
+	dev->_window_count = 0;
+	dev->_window_skip = 0;
 
-void spi_master_init(TFT_t * dev, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+	// Shadow frame buffer (off until lcdSetFrameBuffer)
+	dev->_fb = NULL;
+
+	// Display list (off until lcdSetDisplayList)
+	dev->_dl = NULL;
+
+	// Flush task (off until lcdSetFlushTask)
+	dev->_ring = NULL;
+
+	// Marquee (off until lcdSetMarquee)
+	dev->_marquee = NULL;
+
+	// Row sources give host order colors (until lcdSetPixelFormat)
+	dev->_pixel_format = PIXEL_HOST;
+
+#if LCD_STATS
+	lcdResetStats(dev);
+#endif
+}
+
+// Free the buffers of lcdInitTransport
+// The frame buffer, display list, flush task and marquee must be unset.
+void lcdDeinitTransport(TFT_t * dev)
 {
-	esp_err_t ret;
-
-	ESP_LOGI(TAG, "GPIO_CS=%d",GPIO_CS);
-	gpio_reset_pin( GPIO_CS );
-	gpio_set_direction( GPIO_CS, GPIO_MODE_OUTPUT );
-	gpio_set_level( GPIO_CS, 0 );
-
-	ESP_LOGI(TAG, "GPIO_DC=%d",GPIO_DC);
-	gpio_reset_pin( GPIO_DC );
-	gpio_set_direction( GPIO_DC, GPIO_MODE_OUTPUT );
-	gpio_set_level( GPIO_DC, 0 );
-
-	ESP_LOGI(TAG, "GPIO_RESET=%d",GPIO_RESET);
-	if ( GPIO_RESET >= 0 ) {
-		gpio_reset_pin( GPIO_RESET );
-		gpio_set_direction( GPIO_RESET, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_RESET, 0 );
-		vTaskDelay( pdMS_TO_TICKS( 100 ) );
-		gpio_set_level( GPIO_RESET, 1 );
-	}
-
-	ESP_LOGI(TAG, "GPIO_BL=%d",GPIO_BL);
-	if ( GPIO_BL >= 0 ) {
-		gpio_reset_pin( GPIO_BL );
-		gpio_set_direction( GPIO_BL, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_BL, 0 );
-	}
-
-	spi_bus_config_t buscfg = {
-		.sclk_io_num = GPIO_SCLK,
-		.mosi_io_num = GPIO_MOSI,
-		.miso_io_num = -1,
-		.quadwp_io_num = -1,
-		.quadhd_io_num = -1
-	};
+	assert(dev->_fb == NULL && dev->_dl == NULL && dev->_ring == NULL && dev->_marquee == NULL);
+	spi_master_flush(dev);
+	for(int i=0;i<SPI_BUFFER_COUNT;i++) {
+		heap_caps_free(dev->_buffer[i]);
+		dev->_buffer[i] = NULL;
+	}
+	heap_caps_free(dev->_fill);
+	dev->_fill = NULL;
+	dev->_transport = NULL;
+	dev->_transport_ctx = NULL;
+}
 
-	ret = spi_bus_initialize( HSPI_HOST, &buscfg, 1 );
-	ESP_LOGD(TAG, "spi_bus_initialize=%d",ret);
-	assert(ret==ESP_OK);
 
-	spi_device_interface_config_t devcfg={
-		.clock_speed_hz = SPI_Frequency,
-		.spics_io_num = GPIO_CS,
-		.queue_size = 7,
-		.flags = SPI_DEVICE_NO_DUMMY,
-	};
+// Transfer handed from the drawing task to the flush task
+typedef struct {
+	const uint8_t * data;		// NULL when the bytes are in inline_data
+	uint8_t inline_data[SPI_RING_INLINE];
+	uint32_t length;
+	int16_t dc;
+} SPI_ENTRY_t;
+
+// Single-producer/single-consumer ring between the two tasks.
+// The drawing task owns _trans_queued and the flush task owns
+// _trans_done and taken, so no lock is needed.
+struct SPI_RING {
+	SPI_ENTRY_t entry[SPI_RING_SIZE];
+	uint32_t taken;			// Entries read by the flush task
+	TaskHandle_t draw_task;
+	TaskHandle_t flush_task;
+	bool stop;
+	bool stopped;
+};
+
+// Number of transactions on the wire
+// With the flush task this is written by the other core.
+static inline uint32_t spi_master_done(TFT_t * dev)
+{
+	return __atomic_load_n(&dev->_trans_done, __ATOMIC_ACQUIRE);
+}
+
+// Collect the oldest in-flight transaction
+static void spi_master_collect(TFT_t * dev)
+{
+	LCD_STATS_WAIT_BEGIN();
+	if (dev->_ring) {
+		// The flush task advances _trans_done and wakes us up
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	} else {
+		dev->_transport->result( dev->_transport_ctx );
+		dev->_trans_done++;
+	}
+	LCD_STATS_WAIT_END(dev);
+}
 
-	spi_device_handle_t handle;
-	ret = spi_bus_add_device( HSPI_HOST, &devcfg, &handle);
-	ESP_LOGD(TAG, "spi_bus_add_device=%d",ret);
-	assert(ret==ESP_OK);
-	dev->_dc = GPIO_DC;
-	dev->_bl = GPIO_BL;
-	dev->_SPIHandle = handle;
+// Wait until every queued transaction is on the wire
+void spi_master_flush(TFT_t * dev)
+{
+	while (spi_master_done(dev) != dev->_trans_queued) {
+		spi_master_collect(dev);
+	}
 }
 
+// Hand a transfer to the flush task
+// Short transfers are copied into the ring, so the caller's buffer can
+// be reused. Longer ones must stay untouched until _trans_done passes
+// them, as in the async mode.
+static void spi_master_push(TFT_t * dev, const uint8_t* Data, size_t DataLength, int16_t dc)
+{
+	struct SPI_RING * ring = dev->_ring;
+	uint32_t queued = dev->_trans_queued;
+	while (queued - spi_master_done(dev) == SPI_RING_SIZE) {
+		spi_master_collect(dev);
+	}
+	SPI_ENTRY_t * entry = &ring->entry[queued % SPI_RING_SIZE];
+	if ( DataLength <= SPI_RING_INLINE ) {
+		memcpy( entry->inline_data, Data, DataLength );
+		entry->data = NULL;
+	} else {
+		entry->data = Data;
+	}
+	entry->length = DataLength;
+	entry->dc = dc;
+	__atomic_store_n(&dev->_trans_queued, queued + 1, __ATOMIC_RELEASE);
+
+	// The flush task only sleeps on an empty ring. The fence keeps the
+	// load of taken after the store above; the flush task does the
+	// reverse, so at least one side sees the other's update.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->taken, __ATOMIC_ACQUIRE) == queued) {
+		xTaskNotifyGive(ring->flush_task);
+	}
+}
 
-bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength)
+// Mark the oldest transfer of the ring as done
+static void spi_master_complete(TFT_t * dev)
 {
-	spi_transaction_t SPITransaction;
-	esp_err_t ret;
-
-	if ( DataLength > 0 ) {
-		memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
-		SPITransaction.length = DataLength * 8;
-		SPITransaction.tx_buffer = Data;
-#if 1
-		ret = spi_device_transmit( SPIHandle, &SPITransaction );
-#endif
-#if 0
-		ret = spi_device_polling_transmit( SPIHandle, &SPITransaction );
-#endif
-		assert(ret==ESP_OK); 
+	__atomic_store_n(&dev->_trans_done, dev->_trans_done + 1, __ATOMIC_RELEASE);
+	xTaskNotifyGive(dev->_ring->draw_task);
+}
+
+// Flush task
+// Owns the SPI device while it runs. Short transfers are polled and
+// the others are queued, as spi_master_write_byte does without the task.
+static void spi_master_flush_task(void * pvParameters)
+{
+	TFT_t * dev = pvParameters;
+	struct SPI_RING * ring = dev->_ring;
+	const LCD_TRANSPORT_t * transport = dev->_transport;
+	void * ctx = dev->_transport_ctx;
+	int inflight = 0;
+
+	while (1) {
+		uint32_t queued = __atomic_load_n(&dev->_trans_queued, __ATOMIC_ACQUIRE);
+		if (ring->taken == queued) {
+			if (inflight) {
+				transport->result( ctx );
+				inflight--;
+				spi_master_complete(dev);
+				continue;
+			}
+			if (__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) break;
+			// Look at _trans_queued again after taken was stored, or a
+			// transfer pushed meanwhile would not wake this task
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&dev->_trans_queued, __ATOMIC_ACQUIRE) != queued) continue;
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+
+		SPI_ENTRY_t * entry = &ring->entry[ring->taken % SPI_RING_SIZE];
+		const uint8_t * Data = entry->data ? entry->data : entry->inline_data;
+		if ( entry->length <= dev->_polling_threshold ) {
+			// Polling is not allowed while queued transactions are pending
+			while (inflight) {
+				transport->result( ctx );
+				inflight--;
+				spi_master_complete(dev);
+			}
+			transport->polling( ctx, Data, entry->length, entry->dc );
+			__atomic_store_n(&ring->taken, ring->taken + 1, __ATOMIC_RELEASE);
+			spi_master_complete(dev);
+			continue;
+		}
+
+		if (inflight == SPI_QUEUE_SIZE) {
+			transport->result( ctx );
+			inflight--;
+			spi_master_complete(dev);
+		}
+		transport->queue( ctx, Data, entry->length, entry->dc );
+		inflight++;
+		__atomic_store_n(&ring->taken, ring->taken + 1, __ATOMIC_RELEASE);
 	}
 
+	TaskHandle_t draw_task = ring->draw_task;
+	__atomic_store_n(&ring->stopped, true, __ATOMIC_RELEASE);
+	xTaskNotifyGive(draw_task);
+	vTaskDelete(NULL);
+}
+
+// Get a DMA buffer which is not used by any in-flight transaction.
+// spi_master_write_byte() records the transaction that reads it.
+static uint8_t * spi_master_get_buffer(TFT_t * dev)
+{
+	uint8_t index = dev->_buffer_index;
+	dev->_buffer_index = (index + 1) % SPI_BUFFER_COUNT;
+	while ((int32_t)(spi_master_done(dev) - dev->_buffer_seq[index]) < 0) {
+		spi_master_collect(dev);
+	}
+	return dev->_buffer[index];
+}
+
+// Record the transaction just queued as the reader of a DMA buffer
+// Polled transfers are finished when they return, and are not recorded.
+static void spi_master_mark_buffer(TFT_t * dev, const uint8_t* Data)
+{
+	for(int i=0;i<SPI_BUFFER_COUNT;i++) {
+		if (Data >= dev->_buffer[i] && Data < dev->_buffer[i] + SPI_BUFFER_SIZE) {
+			dev->_buffer_seq[i] = dev->_trans_queued;
+			return;
+		}
+	}
+}
+
+// Move the cached GRAM pointer past the pixels just written
+static void spi_master_advance(TFT_t * dev, size_t DataLength)
+{
+	if (DataLength % 2) {
+		dev->_ram_write = false;
+		return;
+	}
+	uint32_t width = dev->_window_x2 - dev->_window_x1 + 1;
+	uint32_t offset = (dev->_cursor_x - dev->_window_x1) + DataLength / 2;
+	uint32_t row = dev->_cursor_y + offset / width;
+	if (row > dev->_window_y2) {
+		// The controller wrapped around, so the pointer is unknown
+		dev->_ram_write = false;
+		return;
+	}
+	dev->_cursor_x = dev->_window_x1 + offset % width;
+	dev->_cursor_y = row;
+}
+
+bool spi_master_write_byte(TFT_t * dev, const uint8_t* Data, size_t DataLength, int16_t dc)
+{
+	if ( DataLength == 0 ) return true;
+	LCD_STATS_ADD(dev, transactions, 1);
+	LCD_STATS_ADD(dev, bytes, DataLength);
+
+	if ( dc == SPI_Command_Mode ) {
+		LCD_STATS_ADD(dev, commands, 1);
+		// Any command ends Memory Write and may change the window
+		dev->_window_valid = false;
+		dev->_ram_write = false;
+	} else if ( dev->_ram_write ) {
+		spi_master_advance(dev, DataLength);
+	}
+
+	if ( dev->_ring ) {
+		if ( DataLength <= dev->_polling_threshold ) {
+			dev->_polling_count++;
+		} else {
+			dev->_interrupt_count++;
+		}
+		spi_master_push(dev, Data, DataLength, dc);
+		spi_master_mark_buffer(dev, Data);
+		if ( !dev->_async ) spi_master_flush(dev);
+		return true;
+	}
+
+	// Short command/address transfers are cheaper to poll than to
+	// wait for the interrupt. Polling is not allowed while queued
+	// transactions are pending. Behind pixel data they are queued, so
+	// a window set does not wait for the DMA; short ones still pending
+	// are nearly done and are collected first.
+	if ( DataLength <= dev->_polling_threshold && (int32_t)(dev->_trans_done - dev->_bulk_seq) >= 0 ) {
+		spi_master_flush(dev);
+		LCD_STATS_WAIT_BEGIN();
+		dev->_transport->polling( dev->_transport_ctx, Data, DataLength, dc );
+		LCD_STATS_WAIT_END(dev);
+		dev->_polling_count++;
+		return true;
+	}
+	dev->_interrupt_count++;
+
+	if ( dev->_async ) {
+		// Wait for the oldest transfer when the transport queue is full
+		if (dev->_trans_queued - dev->_trans_done == SPI_QUEUE_SIZE) {
+			spi_master_collect(dev);
+		}
+		dev->_transport->queue( dev->_transport_ctx, Data, DataLength, dc );
+		dev->_trans_queued++;
+		if ( DataLength > dev->_polling_threshold ) dev->_bulk_seq = dev->_trans_queued;
+		spi_master_mark_buffer(dev, Data);
+		return true;
+	}
+
+	LCD_STATS_WAIT_BEGIN();
+	dev->_transport->transmit( dev->_transport_ctx, Data, DataLength, dc );
+	LCD_STATS_WAIT_END(dev);
 	return true;
 }
 
 bool spi_master_write_comm_byte(TFT_t * dev, uint8_t cmd)
 {
-	static uint8_t Byte = 0;
-	Byte = cmd;
-	gpio_set_level( dev->_dc, SPI_Command_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &Byte, 1 );
+	uint8_t Byte = cmd;
+	return spi_master_write_byte( dev, &Byte, 1, SPI_Command_Mode );
 }
 
 bool spi_master_write_comm_word(TFT_t * dev, uint16_t cmd)
 {
-	static uint8_t Byte[2];
+	uint8_t Byte[2];
 	Byte[0] = (cmd >> 8) & 0xFF;
 	Byte[1] = cmd & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Command_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 2 );
+	return spi_master_write_byte( dev, Byte, 2, SPI_Command_Mode );
 }
 
 
 bool spi_master_write_data_byte(TFT_t * dev, uint8_t data)
 {
-	static uint8_t Byte = 0;
-	Byte = data;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &Byte, 1 );
+	uint8_t Byte = data;
+	return spi_master_write_byte( dev, &Byte, 1, SPI_Data_Mode );
 }
 
 
 bool spi_master_write_data_word(TFT_t * dev, uint16_t data)
 {
-	static uint8_t Byte[2];
+	uint8_t Byte[2];
 	Byte[0] = (data >> 8) & 0xFF;
 	Byte[1] = data & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 2);
+	return spi_master_write_byte( dev, Byte, 2, SPI_Data_Mode );
 }
 
 bool spi_master_write_addr(TFT_t * dev, uint16_t addr1, uint16_t addr2)
 {
-	static uint8_t Byte[4];
+	uint8_t Byte[4];
 	Byte[0] = (addr1 >> 8) & 0xFF;
 	Byte[1] = addr1 & 0xFF;
 	Byte[2] = (addr2 >> 8) & 0xFF;
 	Byte[3] = addr2 & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 4);
+	return spi_master_write_byte( dev, Byte, 4, SPI_Data_Mode );
 }
 
-bool spi_master_write_color(TFT_t * dev, uint16_t color, uint16_t size)
+// Write the same color size times
+// The fill buffer is only rebuilt when the color changes, and
+// the whole run is sent in as few transactions as the buffer allows.
+bool spi_master_write_color(TFT_t * dev, uint16_t color, uint32_t size)
 {
-	static uint8_t Byte[1024];
-	int index = 0;
-	for(int i=0;i<size;i++) {
-		Byte[index++] = (color >> 8) & 0xFF;
-		Byte[index++] = color & 0xFF;
+	if (!dev->_fill_valid || dev->_fill_color != color) {
+		// Wait for the transactions still reading the old color
+		while ((int32_t)(spi_master_done(dev) - dev->_fill_seq) < 0) {
+			spi_master_collect(dev);
+		}
+		uint8_t * Byte = dev->_fill;
+		int index = 0;
+		for(int i=0;i<SPI_FILL_PIXELS;i++) {
+			Byte[index++] = (color >> 8) & 0xFF;
+			Byte[index++] = color & 0xFF;
+		}
+		dev->_fill_color = color;
+		dev->_fill_valid = true;
+	}
+
+	while (size > 0) {
+		uint32_t length = size;
+		if (length > SPI_FILL_PIXELS) length = SPI_FILL_PIXELS;
+		spi_master_write_byte( dev, dev->_fill, length*2, SPI_Data_Mode );
+		dev->_fill_seq = dev->_trans_queued;
+		size = size - length;
 	}
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, size*2);
+	return true;
 }
 
 // Add 202001
-bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint16_t size)
+// Any number of colors can be written. They are converted in chunks
+// into the DMA buffers, so one chunk is prepared while the previous
+// one is on the wire in async mode.
+bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint32_t size)
 {
-	static uint8_t Byte[1024];
-	int index = 0;
-	for(int i=0;i<size;i++) {
-		Byte[index++] = (colors[i] >> 8) & 0xFF;
-		Byte[index++] = colors[i] & 0xFF;
+	while (size > 0) {
+		uint32_t length = size;
+		if (length > SPI_BUFFER_SIZE/2) length = SPI_BUFFER_SIZE/2;
+		uint8_t * Byte = spi_master_get_buffer(dev);
+		int index = 0;
+		for(uint32_t i=0;i<length;i++) {
+			Byte[index++] = (colors[i] >> 8) & 0xFF;
+			Byte[index++] = colors[i] & 0xFF;
+		}
+		spi_master_write_byte( dev, Byte, length*2, SPI_Data_Mode );
+		colors = colors + length;
+		size = size - length;
 	}
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, size*2);
+	return true;
 }
 
+// Set the address window and start Memory Write (ILI9340/ILI9341)
+// Command, address and data phases are queued back-to-back in async mode.
+// The window is opened down to the bottom of the screen (and a single row
+// up to the right edge), so a write that starts where the previous one
+// ended only needs Memory Write Continue. Column and page addresses that
+// did not change are not sent again.
+void spi_master_write_window(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	uint16_t xe = x2;
+	if (y1 == y2 && xe < dev->_width - 1 + dev->_offsetx) xe = dev->_width - 1 + dev->_offsetx;
+	uint16_t ye = y2;
+	if (ye < dev->_height - 1 + dev->_offsety) ye = dev->_height - 1 + dev->_offsety;
+	LCD_STATS_ADD(dev, windows, 1);
+
+	bool cont = dev->_ram_write && dev->_cursor_x == x1 && dev->_cursor_y == y1
+		&& y2 <= dev->_window_y2 && x1 >= dev->_window_x1 && x2 <= dev->_window_x2
+		&& (y1 == y2 || (x1 == dev->_window_x1 && x2 == dev->_window_x2));
+	if (cont) {
+		spi_master_write_comm_byte(dev, 0x3C);	// Memory Write Continue
+		dev->_window_count++;
+		dev->_window_skip += 2;
+		dev->_window_valid = true;
+		dev->_ram_write = true;
+		return;
+	}
+
+	bool caset = !dev->_window_valid || dev->_window_x1 != x1 || dev->_window_x2 != xe;
+	bool paset = !dev->_window_valid || dev->_window_y1 != y1 || dev->_window_y2 != ye;
+	if (caset) {
+		spi_master_write_comm_byte(dev, 0x2A);	// set column(x) address
+		spi_master_write_addr(dev, x1, xe);
+		dev->_window_count++;
+	} else {
+		dev->_window_skip++;
+	}
+	if (paset) {
+		spi_master_write_comm_byte(dev, 0x2B);	// set Page(y) address
+		spi_master_write_addr(dev, y1, ye);
+		dev->_window_count++;
+	} else {
+		dev->_window_skip++;
+	}
+	spi_master_write_comm_byte(dev, 0x2C);	//  Memory Write
+	dev->_window_count++;
+	dev->_window_x1 = x1;
+	dev->_window_x2 = xe;
+	dev->_window_y1 = y1;
+	dev->_window_y2 = ye;
+	dev->_cursor_x = x1;
+	dev->_cursor_y = y1;
+	dev->_window_valid = true;
+	dev->_ram_write = true;
+}
 
 void delayMS(int ms) {
 	int _ms = ms + (portTICK_PERIOD_MS - 1);
@@ -194,6 +565,8 @@ void lcdWriteRegisterWord(TFT_t * dev, uint16_t addr, uint16_t data)
 
 void lcdWriteRegisterByte(TFT_t * dev, uint8_t addr, uint16_t data)
 {
+	// ILI9225/ILI9226 start every window at the RAM Address
+	if (addr == 0x20) LCD_STATS_ADD(dev, windows, 1);
 	spi_master_write_comm_byte(dev, addr);
 	spi_master_write_data_word(dev, data);
 }
@@ -202,21 +575,32 @@ void lcdWriteRegisterByte(TFT_t * dev, uint8_t addr, uint16_t data)
 
 void lcdInit(TFT_t * dev, uint16_t model, int width, int height, int offsetx, int offsety)
 {
+#ifdef LCD_MODEL
+	if (model != LCD_MODEL) {
+		ESP_LOGE(TAG, "The driver is built for the %x, not the %x", LCD_MODEL, model);
+		assert(model == LCD_MODEL);
+	}
+#endif
 	dev->_model = model;
 	dev->_width = width;
 	dev->_height = height;
 	dev->_offsetx = offsetx;
 	dev->_offsety = offsety;
+	dev->_gram_width = width + offsetx * 2;
+	dev->_gram_height = height + offsety * 2;
+	dev->_rotation = DIRECTION0;
+	dev->_madctl = 0x08;
 	dev->_font_direction = DIRECTION0;
+	dev->_font_scale = 1;
 	dev->_font_fill = false;
 	dev->_font_underline = false;
 
-	if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
-		if (dev->_model == 0x9340)
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
+		if (lcdModel(dev) == 0x9340)
 			ESP_LOGI(TAG,"Your TFT is ILI9340");
-		if (dev->_model == 0x9341)
+		if (lcdModel(dev) == 0x9341)
 			ESP_LOGI(TAG,"Your TFT is ILI9341");
-		if (dev->_model == 0x7735)
+		if (lcdModel(dev) == 0x7735)
 			ESP_LOGI(TAG,"Your TFT is ST7735");
 		ESP_LOGI(TAG,"Screen width:%d",width);
 		ESP_LOGI(TAG,"Screen height:%d",height);
@@ -295,7 +679,7 @@ void lcdInit(TFT_t * dev, uint16_t model, int width, int height, int offsetx, in
 		spi_master_write_comm_byte(dev, 0x29);	//Display ON
 	} // endif 0x9340/0x9341/0x7735
 
-	if (dev->_model == 0x9225) {
+	if (lcdModel(dev) == 0x9225) {
 		ESP_LOGI(TAG,"Your TFT is ILI9225");
 		ESP_LOGI(TAG,"Screen width:%d",width);
 		ESP_LOGI(TAG,"Screen height:%d",height);
@@ -358,7 +742,7 @@ void lcdInit(TFT_t * dev, uint16_t model, int width, int height, int offsetx, in
 		lcdWriteRegisterByte(dev, 0x07, 0x1017);
 	} // endif 0x9225
 
-	if (dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9226) {
 		ESP_LOGI(TAG,"Your TFT is ILI9225G");
 		ESP_LOGI(TAG,"Screen width:%d",width);
 		ESP_LOGI(TAG,"Screen height:%d",height);
@@ -407,34 +791,120 @@ void lcdInit(TFT_t * dev, uint16_t model, int width, int height, int offsetx, in
 		lcdWriteRegisterByte(dev, 0x07,0x1017);
 	} // endif 0x9226
 
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 1 );
+	dev->_transport->backlight( dev->_transport_ctx, 1 );
+}
+
+
+// Mark the tiles under a rectangle as drawn
+static void lcdFrameDirty(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+	int tiles_x = (dev->_width + FB_TILE_SIZE - 1) / FB_TILE_SIZE;
+	for(int ty=y1/FB_TILE_SIZE;ty<=y2/FB_TILE_SIZE;ty++) {
+		for(int tx=x1/FB_TILE_SIZE;tx<=x2/FB_TILE_SIZE;tx++) {
+			dev->_fb_dirty[ty * tiles_x + tx] = 1;
+		}
 	}
 }
 
+// Display list
+// Drawing is recorded as commands and replayed band by band in lcdFlush().
+#define DL_RECT		0
+#define DL_PIXELS	1
+#define DL_GLYPH	2
+#define DL_SOURCE	3
+
+typedef struct {
+	uint8_t type;
+	uint16_t x1, y1, x2, y2;	// Rectangle on the screen
+	uint16_t color;
+	uint16_t data;				// Offset of the stored data in the arena
+	union {
+		struct {
+			uint32_t start;		// First pixel in the rectangle
+			uint16_t size;		// Number of pixels
+		} pixels;
+		struct {
+			uint8_t count;
+			uint8_t dir;
+			uint8_t pw;
+			uint8_t ph;
+			uint8_t scale;
+			bool fill;
+			bool underline;
+			uint16_t fill_color;
+			uint16_t underline_color;
+		} glyph;
+		struct {
+			lcdRowSource_t func;
+			void * arg;
+			bool wire;
+		} source;
+	} u;
+} DL_CMD_t;
+
+struct DISPLAY_LIST {
+	DL_CMD_t cmd[DL_COMMANDS];
+	int count;
+	uint8_t arena[DL_ARENA_SIZE] __attribute__((aligned(4)));
+	int used;
+	uint16_t * band[2];		// Ping-pong band buffers in wire order
+	uint32_t band_seq[2];
+	uint8_t * mask;			// Pixels of the band drawn by a command
+	uint16_t * line;		// Row buffer for row sources
+};
+
+// Add a command to the display list
+// bytes:Size of the data stored with the command, returned in data
+// A full list is flushed first.
+static DL_CMD_t * lcdListAppend(TFT_t * dev, uint8_t type, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color, size_t bytes, void ** data) {
+	struct DISPLAY_LIST * dl = dev->_dl;
+	if (dl->count == DL_COMMANDS || dl->used + bytes > DL_ARENA_SIZE) {
+		ESP_LOGD(TAG, "Display list full, flushing early");
+		lcdFlush(dev);
+	}
+	DL_CMD_t * cmd = &dl->cmd[dl->count++];
+	cmd->type = type;
+	cmd->x1 = x1;
+	cmd->y1 = y1;
+	cmd->x2 = x2;
+	cmd->y2 = y2;
+	cmd->color = color;
+	if (bytes) {
+		*data = &dl->arena[dl->used];
+		cmd->data = dl->used;
+		dl->used += (bytes + 3) & ~3;
+	}
+	return cmd;
+}
 
 // Draw pixel
 // x:X coordinate
 // y:Y coordinate
 // color:color
 void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
+	LCD_STATS_CALL(dev, draw_pixel);
 	if (x >= dev->_width) return;
 	if (y >= dev->_height) return;
 
+	if (dev->_fb) {
+		dev->_fb[y * dev->_width + x] = color;
+		lcdFrameDirty(dev, x, y, x, y);
+		return;
+	}
+	if (dev->_dl) {
+		lcdListAppend(dev, DL_RECT, x, y, x, y, color, 0, NULL);
+		return;
+	}
+
 	uint16_t _x = x + dev->_offsetx;
 	uint16_t _y = y + dev->_offsety;
 
-	//if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341) {
-		spi_master_write_comm_byte(dev, 0x2A);	// set column(x) address
-		spi_master_write_addr(dev, _x, _x);
-		spi_master_write_comm_byte(dev, 0x2B);	// set Page(y) address
-		spi_master_write_addr(dev, _y, _y);
-		spi_master_write_comm_byte(dev, 0x2C);	//  Memory Write
+	//if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
+		spi_master_write_window(dev, _x, _y, _x, _y);
 		spi_master_write_data_word(dev, color);
 	} // endif 0x9340/0x9341
 
-	if (dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x7735) {
 		spi_master_write_comm_byte(dev, 0x2A);	// set column(x) address
 		spi_master_write_data_word(dev, _x);
 		spi_master_write_data_word(dev, _x);
@@ -445,14 +915,14 @@ void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 		spi_master_write_data_word(dev, color);
 	} // endif 0x7735
 
-	if (dev->_model == 0x9225) {
+	if (lcdModel(dev) == 0x9225) {
 		lcdWriteRegisterByte(dev, 0x20, _x);
 		lcdWriteRegisterByte(dev, 0x21, _y);
 		spi_master_write_comm_byte(dev, 0x22);	// Memory Write
 		spi_master_write_data_word(dev, color);
 	} // endif 0x9225
 
-	if (dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x36, _x);
 		lcdWriteRegisterByte(dev, 0x37, _x);
 		lcdWriteRegisterByte(dev, 0x38, _y);
@@ -471,9 +941,26 @@ void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 // size:Number of colors
 // colors:colors
 void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint16_t * colors) {
+    LCD_STATS_CALL(dev, draw_multi_pixels);
     if (x+size > dev->_width) return;
     if (y >= dev->_height) return;
 
+    if (dev->_fb) {
+        if (size == 0) return;
+        memcpy(&dev->_fb[y * dev->_width + x], colors, size * 2);
+        lcdFrameDirty(dev, x, y, x+size-1, y);
+        return;
+    }
+    if (dev->_dl) {
+        if (size == 0) return;
+        void * data;
+        DL_CMD_t * cmd = lcdListAppend(dev, DL_PIXELS, x, y, x+size-1, y, 0, size * 2, &data);
+        memcpy(data, colors, size * 2);
+        cmd->u.pixels.start = 0;
+        cmd->u.pixels.size = size;
+        return;
+    }
+
     ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
     uint16_t _x1 = x + dev->_offsetx;
     uint16_t _x2 = _x1 + size;
@@ -481,17 +968,13 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
     uint16_t _y2 = _y1;
     ESP_LOGD(TAG,"_x1=%d _x2=%d _y1=%d _y2=%d",_x1, _x2, _y1, _y2);
 
-    //if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
-    if (dev->_model == 0x9340 || dev->_model == 0x9341) {
-        spi_master_write_comm_byte(dev, 0x2A);  // set column(x) address
-        spi_master_write_addr(dev, _x1, _x2);
-        spi_master_write_comm_byte(dev, 0x2B);  // set Page(y) address
-        spi_master_write_addr(dev, _y1, _y2);
-        spi_master_write_comm_byte(dev, 0x2C);  //  Memory Write
+    //if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
+    if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
+        spi_master_write_window(dev, _x1, _y1, _x1+size-1, _y2);
         spi_master_write_colors(dev, colors, size);
     } // endif 0x9340/0x9341
 
-    if (dev->_model == 0x7735) {
+    if (lcdModel(dev) == 0x7735) {
         spi_master_write_comm_byte(dev, 0x2A);  // set column(x) address
         spi_master_write_data_word(dev, _x1);
         spi_master_write_data_word(dev, _x2);
@@ -502,7 +985,7 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
         spi_master_write_colors(dev, colors, size);
     } // 0x7735
 
-    if (dev->_model == 0x9225) {
+    if (lcdModel(dev) == 0x9225) {
         for(int j=_y1;j<=_y2;j++){
             lcdWriteRegisterByte(dev, 0x20, _x1);
             lcdWriteRegisterByte(dev, 0x21, j);
@@ -511,7 +994,7 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
         }
     } // endif 0x9225
 
-    if (dev->_model == 0x9226) {
+    if (lcdModel(dev) == 0x9226) {
         for(int j=_x1;j<=_x2;j++) {
             lcdWriteRegisterByte(dev, 0x36, j);
             lcdWriteRegisterByte(dev, 0x37, j);
@@ -527,6 +1010,219 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
 }
 
 
+// Set the address window on the panel
+static void lcdPanelBeginPixels(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+	uint16_t _x1 = x1 + dev->_offsetx;
+	uint16_t _x2 = x2 + dev->_offsetx;
+	uint16_t _y1 = y1 + dev->_offsety;
+	uint16_t _y2 = y2 + dev->_offsety;
+
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
+		spi_master_write_window(dev, _x1, _y1, _x2, _y2);
+	} // endif 0x9340/0x9341
+
+	if (lcdModel(dev) == 0x7735) {
+		spi_master_write_comm_byte(dev, 0x2A);	// set column(x) address
+		spi_master_write_data_word(dev, _x1);
+		spi_master_write_data_word(dev, _x2);
+		spi_master_write_comm_byte(dev, 0x2B);	// set Page(y) address
+		spi_master_write_data_word(dev, _y1);
+		spi_master_write_data_word(dev, _y2);
+		spi_master_write_comm_byte(dev, 0x2C);	//  Memory Write
+	} // 0x7735
+
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
+		lcdWriteRegisterByte(dev, 0x36, _x2);	// Horizontal Window Address End
+		lcdWriteRegisterByte(dev, 0x37, _x1);	// Horizontal Window Address Start
+		lcdWriteRegisterByte(dev, 0x38, _y2);	// Vertical Window Address End
+		lcdWriteRegisterByte(dev, 0x39, _y1);	// Vertical Window Address Start
+		lcdWriteRegisterByte(dev, 0x20, _x1);	// RAM Address
+		lcdWriteRegisterByte(dev, 0x21, _y1);	// RAM Address
+		spi_master_write_comm_byte(dev, 0x22);	// Memory Write
+	} // endif 0x9225/0x9226
+}
+
+static void lcdPanelEndPixels(TFT_t * dev) {
+	if (lcdModel(dev) == 0x9225) {
+		// The other ILI9225 primitives expect the whole GRAM as window
+		lcdWriteRegisterByte(dev, 0x36, 0x00AF);
+		lcdWriteRegisterByte(dev, 0x37, 0x0000);
+		lcdWriteRegisterByte(dev, 0x38, 0x00DB);
+		lcdWriteRegisterByte(dev, 0x39, 0x0000);
+	} // endif 0x9225
+}
+
+// Start writing pixels to a window
+// x1:Start X coordinate
+// y1:Start Y coordinate
+// x2:End X coordinate
+// y2:End Y coordinate
+// The window is filled row by row with lcdPushPixels().
+// Returns false when the window is not on the screen.
+bool lcdBeginPixels(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+	if (x1 > x2 || y1 > y2) return false;
+	if (x2 >= dev->_width) return false;
+	if (y2 >= dev->_height) return false;
+
+	if (dev->_fb || dev->_dl) {
+		dev->_fb_x1 = x1;
+		dev->_fb_x2 = x2;
+		dev->_fb_y1 = y1;
+		dev->_fb_y2 = y2;
+		dev->_fb_cx = x1;
+		dev->_fb_cy = y1;
+		if (dev->_fb) lcdFrameDirty(dev, x1, y1, x2, y2);
+		return true;
+	}
+	lcdPanelBeginPixels(dev, x1, y1, x2, y2);
+	return true;
+}
+
+// Write pixels to the window started by lcdBeginPixels
+// colors:colors
+// size:Number of colors (any length)
+void lcdPushPixels(TFT_t * dev, uint16_t * colors, uint32_t size) {
+	if (dev->_fb) {
+		while (size > 0) {
+			uint32_t length = dev->_fb_x2 - dev->_fb_cx + 1;
+			if (length > size) length = size;
+			memcpy(&dev->_fb[dev->_fb_cy * dev->_width + dev->_fb_cx], colors, length * 2);
+			colors = colors + length;
+			size = size - length;
+			dev->_fb_cx = dev->_fb_cx + length;
+			if (dev->_fb_cx > dev->_fb_x2) {
+				dev->_fb_cx = dev->_fb_x1;
+				dev->_fb_cy = (dev->_fb_cy == dev->_fb_y2) ? dev->_fb_y1 : dev->_fb_cy + 1;
+			}
+		}
+		return;
+	}
+	if (dev->_dl) {
+		// Recorded in pieces that fit the arena
+		uint32_t width = dev->_fb_x2 - dev->_fb_x1 + 1;
+		uint32_t height = dev->_fb_y2 - dev->_fb_y1 + 1;
+		while (size > 0) {
+			uint32_t length = size;
+			if (length > DL_ARENA_SIZE / 4) length = DL_ARENA_SIZE / 4;
+			uint32_t start = (dev->_fb_cy - dev->_fb_y1) * width + (dev->_fb_cx - dev->_fb_x1);
+			void * data;
+			DL_CMD_t * cmd = lcdListAppend(dev, DL_PIXELS, dev->_fb_x1, dev->_fb_y1, dev->_fb_x2, dev->_fb_y2, 0, length * 2, &data);
+			memcpy(data, colors, length * 2);
+			cmd->u.pixels.start = start;
+			cmd->u.pixels.size = length;
+			colors = colors + length;
+			size = size - length;
+			start = (start + length) % (width * height);
+			dev->_fb_cx = dev->_fb_x1 + start % width;
+			dev->_fb_cy = dev->_fb_y1 + start / width;
+		}
+		return;
+	}
+	spi_master_write_colors(dev, colors, size);
+}
+
+// Finish writing pixels
+void lcdEndPixels(TFT_t * dev) {
+	if (dev->_fb || dev->_dl) return;
+	lcdPanelEndPixels(dev);
+}
+
+// Draw bitmap
+// x:Start X coordinate
+// y:Start Y coordinate
+// w:Width
+// h:Height
+// colors:w*h colors, row by row
+// The part outside the screen is clipped.
+void lcdDrawBitmap(TFT_t * dev, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t * colors) {
+	if (w == 0 || h == 0) return;
+	if (x >= dev->_width) return;
+	if (y >= dev->_height) return;
+	uint16_t _w = w;
+	uint16_t _h = h;
+	if (x + _w > dev->_width) _w = dev->_width - x;
+	if (y + _h > dev->_height) _h = dev->_height - y;
+
+	lcdBeginPixels(dev, x, y, x+_w-1, y+_h-1);
+	if (_w == w) {
+		lcdPushPixels(dev, colors, (uint32_t)_w * _h);
+	} else {
+		for(int row=0;row<_h;row++) {
+			lcdPushPixels(dev, &colors[row*w], _w);
+		}
+	}
+	lcdEndPixels(dev);
+}
+
+// Draw image rows from a source
+// x:Start X coordinate
+// y:Start Y coordinate
+// w:Width
+// h:Height
+// source:Called for every visible row
+// With a display list the rows are read while the list is flushed,
+// so the source must stay valid until lcdFlush().
+// In PIXEL_WIRE format the rows are written by the source straight
+// into the DMA buffers (or the band of the display list) and sent
+// without another copy.
+void lcdDrawRowSource(TFT_t * dev, uint16_t x, uint16_t y, uint16_t w, uint16_t h, lcdRowSource_t source, void * arg) {
+	if (w == 0 || h == 0) return;
+	if (x >= dev->_width) return;
+	if (y >= dev->_height) return;
+	uint16_t _w = w;
+	uint16_t _h = h;
+	if (x + _w > dev->_width) _w = dev->_width - x;
+	if (y + _h > dev->_height) _h = dev->_height - y;
+	bool wire = (dev->_pixel_format == PIXEL_WIRE);
+
+	if (dev->_dl) {
+		DL_CMD_t * cmd = lcdListAppend(dev, DL_SOURCE, x, y, x+_w-1, y+_h-1, 0, 0, NULL);
+		cmd->u.source.func = source;
+		cmd->u.source.arg = arg;
+		cmd->u.source.wire = wire;
+		return;
+	}
+	if (dev->_fb) {
+		// The frame buffer is in host order
+		for(int row=0;row<_h;row++) {
+			uint16_t * line = &dev->_fb[(y + row) * dev->_width + x];
+			source(arg, row, line, _w);
+			if (wire) {
+				for(int i=0;i<_w;i++) line[i] = (line[i] >> 8) | (line[i] << 8);
+			}
+		}
+		lcdFrameDirty(dev, x, y, x+_w-1, y+_h-1);
+		return;
+	}
+
+	int rows = SPI_BUFFER_SIZE / 2 / _w;
+	if (wire && rows > 0) {
+		lcdBeginPixels(dev, x, y, x+_w-1, y+_h-1);
+		for(int row=0;row<_h;row+=rows) {
+			int count = _h - row;
+			if (count > rows) count = rows;
+			uint8_t * Byte = spi_master_get_buffer(dev);
+			uint16_t * colors = (uint16_t *)Byte;
+			for(int j=0;j<count;j++) source(arg, row + j, &colors[j * _w], _w);
+			spi_master_write_byte( dev, Byte, count * _w * 2, SPI_Data_Mode );
+		}
+		lcdEndPixels(dev);
+		return;
+	}
+
+	uint16_t * colors = (uint16_t*)malloc(sizeof(uint16_t) * _w);
+	if (colors == NULL) return;
+	lcdBeginPixels(dev, x, y, x+_w-1, y+_h-1);
+	for(int row=0;row<_h;row++) {
+		source(arg, row, colors, _w);
+		if (wire) {
+			for(int i=0;i<_w;i++) colors[i] = (colors[i] >> 8) | (colors[i] << 8);
+		}
+		lcdPushPixels(dev, colors, _w);
+	}
+	lcdEndPixels(dev);
+	free(colors);
+}
 
 // Draw rectangle of filling
 // x1:Start X coordinate
@@ -535,31 +1231,41 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
 // y2:End Y coordinate
 // color:color
 void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color) {
+	LCD_STATS_CALL(dev, draw_fill_rect);
 	if (x1 >= dev->_width) return;
 	if (x2 >= dev->_width) x2=dev->_width-1;
 	if (y1 >= dev->_height) return;
 	if (y2 >= dev->_height) y2=dev->_height-1;
 
+	if (dev->_dl) {
+		if (x1 > x2 || y1 > y2) return;
+		lcdListAppend(dev, DL_RECT, x1, y1, x2, y2, color, 0, NULL);
+		return;
+	}
+	if (dev->_fb) {
+		if (x1 > x2 || y1 > y2) return;
+		for(int y=y1;y<=y2;y++) {
+			uint16_t * line = &dev->_fb[y * dev->_width];
+			for(int x=x1;x<=x2;x++) line[x] = color;
+		}
+		lcdFrameDirty(dev, x1, y1, x2, y2);
+		return;
+	}
+
 	ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
 	uint16_t _x1 = x1 + dev->_offsetx;
 	uint16_t _x2 = x2 + dev->_offsetx;
 	uint16_t _y1 = y1 + dev->_offsety;
 	uint16_t _y2 = y2 + dev->_offsety;
 
-	//if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341) {
-		spi_master_write_comm_byte(dev, 0x2A);	// set column(x) address
-		spi_master_write_addr(dev, _x1, _x2);
-		spi_master_write_comm_byte(dev, 0x2B);	// set Page(y) address
-		spi_master_write_addr(dev, _y1, _y2);
-		spi_master_write_comm_byte(dev, 0x2C);	//  Memory Write
-		for(int i=_x1;i<=_x2;i++) {
-			uint16_t size = _y2-_y1+1;
-			spi_master_write_color(dev, color, size);
-		}
+	//if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
+		spi_master_write_window(dev, _x1, _y1, _x2, _y2);
+		uint32_t size = (_x2-_x1+1) * (_y2-_y1+1);
+		spi_master_write_color(dev, color, size);
 	} // endif 0x9340/0x9341
 
-	if (dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x7735) {
 		spi_master_write_comm_byte(dev, 0x2A);	// set column(x) address
 		spi_master_write_data_word(dev, _x1);
 		spi_master_write_data_word(dev, _x2);
@@ -567,13 +1273,11 @@ void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_
 		spi_master_write_data_word(dev, _y1);
 		spi_master_write_data_word(dev, _y2);
 		spi_master_write_comm_byte(dev, 0x2C);	//  Memory Write
-		for(int i=_x1;i<=_x2;i++) {
-			uint16_t size = _y2-_y1+1;
-			spi_master_write_color(dev, color, size);
-		}
+		uint32_t size = (_x2-_x1+1) * (_y2-_y1+1);
+		spi_master_write_color(dev, color, size);
 	} // 0x7735
 
-	if (dev->_model == 0x9225) {
+	if (lcdModel(dev) == 0x9225) {
 		for(int j=_y1;j<=_y2;j++){
 			lcdWriteRegisterByte(dev, 0x20, _x1);
 			lcdWriteRegisterByte(dev, 0x21, j);
@@ -583,7 +1287,7 @@ void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_
 		}
 	} // endif 0x9225
 
-	if (dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9226) {
 		for(int j=_x1;j<=_x2;j++) {
 			lcdWriteRegisterByte(dev, 0x36, j);
 			lcdWriteRegisterByte(dev, 0x37, j);
@@ -606,11 +1310,11 @@ void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_
 
 // Display OFF
 void lcdDisplayOff(TFT_t * dev) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
 		spi_master_write_comm_byte(dev, 0x28);
 	} // endif 0x9340/0x9341/0x7735
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x07, 0x1014);
 	} // endif 0x9225/0x9226
 
@@ -618,11 +1322,11 @@ void lcdDisplayOff(TFT_t * dev) {
  
 // Display ON
 void lcdDisplayOn(TFT_t * dev) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
 		spi_master_write_comm_byte(dev, 0x29);
 	} // endif 0x9340/0x9341/0x7735
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x07, 0x1017);
 	} // endif 0x9225/0x9226
 
@@ -630,37 +1334,110 @@ void lcdDisplayOn(TFT_t * dev) {
 
 // Display Inversion OFF
 void lcdInversionOff(TFT_t * dev) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
 		spi_master_write_comm_byte(dev, 0x20);
 	} // endif 0x9340/0x9341/0x7735
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x07, 0x1017);
 	} // endif 0x9225/0x9226
 }
 
 // Display Inversion ON
 void lcdInversionOn(TFT_t * dev) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
 		spi_master_write_comm_byte(dev, 0x21);
 	} // endif 0x9340/0x9341/0x7735
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x07, 0x1013);
 	} // endif 0x9225/0x9226
 }
 
 // Change Memory Access Control
 void lcdBGRFilter(TFT_t * dev) {
-	if (dev->_model == 0x9340 || dev->_model == 0x9341 || dev->_model == 0x7735) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341 || lcdModel(dev) == 0x7735) {
+		dev->_madctl &= ~0x08;
 		spi_master_write_comm_byte(dev, 0x36);	//Memory Access Control
-		spi_master_write_data_byte(dev, 0x00);	//Right top start, RGB color filter panel
+		spi_master_write_data_byte(dev, dev->_madctl);	//RGB color filter panel
 	} // endif 0x9340/0x9341/0x7735
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x03, 0x0030); // set GRAM write direction and BGR=0.
 	} // endif 0x9225/0x9226
 }
+
+// Set the size of the controller's GRAM around the panel
+// width,height:GRAM size in the orientation of lcdInit()
+// lcdInit() takes the panel with its offsets on both sides, which is
+// right for panels in the middle of the GRAM. Others (such as 128x128
+// ST7735 panels at one end of a 132x162 GRAM) need this for rotation.
+void lcdSetGRAMSize(TFT_t * dev, uint16_t width, uint16_t height) {
+	dev->_gram_width = width;
+	dev->_gram_height = height;
+}
+
+// Rotate the screen
+// rotation:DIRECTION0/90/180/270, clockwise from the orientation of lcdInit()
+// The panel exchanges (MV) and mirrors (MX/MY) its address counters, so
+// every drawing, including the block writes of text, costs the same as
+// in DIRECTION0. With DIRECTION90 and DIRECTION270 width and height are
+// exchanged. Along a mirrored axis the offset is counted from the other
+// end of the GRAM (see lcdSetGRAMSize). What is on the panel stays, but
+// the frame buffer starts black again, and a marquee is stopped.
+// Returns false when the panel can not be rotated.
+bool lcdSetRotation(TFT_t * dev, uint16_t rotation) {
+	static const uint8_t madctl[] = {
+		0x00,			// DIRECTION0
+		0x20 | 0x80,	// DIRECTION90: MV MY
+		0x40 | 0x80,	// DIRECTION180: MX MY
+		0x20 | 0x40,	// DIRECTION270: MV MX
+	};
+	if (rotation > DIRECTION270) return false;
+	if (lcdModel(dev) != 0x9340 && lcdModel(dev) != 0x9341 && lcdModel(dev) != 0x7735) {
+		ESP_LOGW(TAG, "The %x can not be rotated", lcdModel(dev));
+		return false;
+	}
+	if (rotation == dev->_rotation) return true;
+
+	// The buffers have the size of the screen
+	bool fb = dev->_fb != NULL;
+	bool dl = dev->_dl != NULL;
+	lcdUnsetMarquee(dev);
+	lcdUnsetFrameBuffer(dev);
+	lcdUnsetDisplayList(dev);
+	lcdFlush(dev);
+
+	// Panel size and offsets along the axes of lcdInit() (0:X 1:Y)
+	int gram[2] = { dev->_gram_width, dev->_gram_height };
+	int size[2], offset[2];
+	uint8_t bits = madctl[dev->_rotation];
+	int ax = (bits & 0x20) ? 1 : 0;
+	int ay = 1 - ax;
+	size[ax] = dev->_width;
+	size[ay] = dev->_height;
+	offset[ax] = (bits & 0x40) ? gram[ax] - size[ax] - dev->_offsetx : dev->_offsetx;
+	offset[ay] = (bits & 0x80) ? gram[ay] - size[ay] - dev->_offsety : dev->_offsety;
+
+	bits = madctl[rotation];
+	ax = (bits & 0x20) ? 1 : 0;
+	ay = 1 - ax;
+	dev->_width = size[ax];
+	dev->_height = size[ay];
+	dev->_offsetx = (bits & 0x40) ? gram[ax] - size[ax] - offset[ax] : offset[ax];
+	dev->_offsety = (bits & 0x80) ? gram[ay] - size[ay] - offset[ay] : offset[ay];
+	dev->_rotation = rotation;
+	dev->_madctl = (dev->_madctl & 0x08) | madctl[rotation];
+	spi_master_write_comm_byte(dev, 0x36);	//Memory Access Control
+	spi_master_write_data_byte(dev, dev->_madctl);
+	dev->_window_valid = false;
+	ESP_LOGI(TAG, "Rotation:%d Screen width:%d height:%d offset:%d,%d", rotation, dev->_width, dev->_height, dev->_offsetx, dev->_offsety);
+
+	if (fb && !lcdSetFrameBuffer(dev)) return false;
+	if (dl && !lcdSetDisplayList(dev)) return false;
+	return true;
+}
+
 // Fill screen
 // color:color
 void lcdFillScreen(TFT_t * dev, uint16_t color) {
@@ -673,11 +1450,14 @@ void lcdFillScreen(TFT_t * dev, uint16_t color) {
 // x2:End X coordinate
 // y2:End Y coordinate
 // color:color 
+// The Bresenham steps are collected into horizontal (or vertical) runs,
+// and each run is written as one rectangle fill.
 void lcdDrawLine(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color) {
 	int i;
 	int dx,dy;
 	int sx,sy;
 	int E;
+	int run;
 
 	/* distance between two points */
 	dx = ( x2 > x1 ) ? x2 - x1 : x1 - x2;
@@ -690,23 +1470,39 @@ void lcdDrawLine(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2
 	/* inclination < 1 */
 	if ( dx > dy ) {
 		E = -dx;
+		run = x1;
 		for ( i = 0 ; i <= dx ; i++ ) {
-			lcdDrawPixel(dev, x1, y1, color);
-			x1 += sx;
 			E += 2 * dy;
+			if ( E >= 0 || i == dx ) {
+				if (sx > 0) {
+					lcdDrawFillRect(dev, run, y1, x1, y1, color);
+				} else {
+					lcdDrawFillRect(dev, x1, y1, run, y1, color);
+				}
+				run = x1 + sx;
+			}
+			x1 += sx;
 			if ( E >= 0 ) {
-			y1 += sy;
-			E -= 2 * dx;
+				y1 += sy;
+				E -= 2 * dx;
+			}
 		}
-	}
 
 /* inclination >= 1 */
 	} else {
 		E = -dy;
+		run = y1;
 		for ( i = 0 ; i <= dy ; i++ ) {
-			lcdDrawPixel(dev, x1, y1, color);
-			y1 += sy;
 			E += 2 * dx;
+			if ( E >= 0 || i == dy ) {
+				if (sy > 0) {
+					lcdDrawFillRect(dev, x1, run, x1, y1, color);
+				} else {
+					lcdDrawFillRect(dev, x1, y1, x1, run, color);
+				}
+				run = y1 + sy;
+			}
+			y1 += sy;
 			if ( E >= 0 ) {
 				x1 += sx;
 				E -= 2 * dy;
@@ -728,6 +1524,86 @@ void lcdDrawRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2
 	lcdDrawLine(dev, x1, y2, x1, y1, color);
 }
 
+// Fill a horizontal or vertical span
+// Coordinates may be negative or off the screen; the span is clipped.
+static void lcdFillSpan(TFT_t * dev, int x1, int y1, int x2, int y2, uint16_t color) {
+	int temp;
+	if (x1 > x2) {
+		temp=x1; x1=x2; x2=temp;
+	}
+	if (y1 > y2) {
+		temp=y1; y1=y2; y2=temp;
+	}
+	if (x2 < 0 || x1 >= dev->_width) return;
+	if (y2 < 0 || y1 >= dev->_height) return;
+	if (x1 < 0) x1 = 0;
+	if (y1 < 0) y1 = 0;
+	lcdDrawFillRect(dev, x1, y1, x2, y2, color);
+}
+
+// Integer square root
+static uint32_t lcdSqrt(uint32_t n) {
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+	while (bit > n) bit >>= 2;
+	while (bit) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+// The points of a quarter circle are collected into horizontal
+// or vertical runs, so that every run is written as one span.
+typedef struct {
+	int x1, y1;	// First point of the run
+	int x2, y2;	// Last point of the run
+	int dir;	// 0:Single point 1:Horizontal 2:Vertical
+	bool valid;
+} ARC_RUN_t;
+
+// Add a point to the run
+// Returns true and the finished run in done when the point starts a new run.
+static bool lcdArcStep(ARC_RUN_t * run, int x, int y, ARC_RUN_t * done) {
+	if (run->valid) {
+		if (run->dir != 2 && y == run->y2 && (x == run->x2 + 1 || x == run->x2 - 1)) {
+			run->x2 = x;
+			run->dir = 1;
+			return false;
+		}
+		if (run->dir != 1 && x == run->x2 && (y == run->y2 + 1 || y == run->y2 - 1)) {
+			run->y2 = y;
+			run->dir = 2;
+			return false;
+		}
+		*done = *run;
+	}
+	run->x1 = run->x2 = x;
+	run->y1 = run->y2 = y;
+	run->dir = 0;
+	bool finished = run->valid;
+	run->valid = true;
+	return finished;
+}
+
+// Draw a run mapped to (cx + a*x + b*y, cy + c*x + d*y)
+static void lcdDrawArcRun(TFT_t * dev, ARC_RUN_t * run, int cx, int cy, int a, int b, int c, int d, uint16_t color) {
+	lcdFillSpan(dev, cx + a*run->x1 + b*run->y1, cy + c*run->x1 + d*run->y1,
+		cx + a*run->x2 + b*run->y2, cy + c*run->x2 + d*run->y2, color);
+}
+
+static void lcdDrawCircleRun(TFT_t * dev, ARC_RUN_t * run, int x0, int y0, uint16_t color) {
+	lcdDrawArcRun(dev, run, x0, y0, -1, 0, 0, 1, color);
+	lcdDrawArcRun(dev, run, x0, y0, 0, -1, -1, 0, color);
+	lcdDrawArcRun(dev, run, x0, y0, 1, 0, 0, -1, color);
+	lcdDrawArcRun(dev, run, x0, y0, 0, 1, 1, 0, color);
+}
+
 // Draw circle
 // x0:Central X coordinate
 // y0:Central Y coordinate
@@ -738,18 +1614,19 @@ void lcdDrawCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t c
 	int y;
 	int err;
 	int old_err;
+	ARC_RUN_t run;
+	ARC_RUN_t done;
 
 	x=0;
 	y=-r;
 	err=2-2*r;
+	run.valid = false;
 	do{
-		lcdDrawPixel(dev, x0-x, y0+y, color); 
-		lcdDrawPixel(dev, x0-y, y0-x, color); 
-		lcdDrawPixel(dev, x0+x, y0-y, color); 
-		lcdDrawPixel(dev, x0+y, y0+x, color); 
+		if (lcdArcStep(&run, x, y, &done)) lcdDrawCircleRun(dev, &done, x0, y0, color);
 		if ((old_err=err)<=x)   err+=++x*2+1;
 		if (old_err>y || err>x) err+=++y*2+1;    
 	} while(y<0);
+	if (run.valid) lcdDrawCircleRun(dev, &run, x0, y0, color);
 }
 
 // Draw circle of filling
@@ -757,26 +1634,41 @@ void lcdDrawCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t c
 // y0:Central Y coordinate
 // r:radius
 // color:color
+// Every row of the circle is written once as a horizontal span.
 void lcdDrawFillCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t color) {
 	int x;
 	int y;
 	int err;
 	int old_err;
 	int ChangeX;
+	int dx;		// Half width of the rows not written yet
+	int dy;		// Lowest row (distance from y0) not written yet
 
 	x=0;
 	y=-r;
 	err=2-2*r;
 	ChangeX=1;
+	dx=0;
+	dy=r;
 	do{
 		if(ChangeX) {
-			lcdDrawLine(dev, x0-x, y0-y, x0-x, y0+y, color);
-			lcdDrawLine(dev, x0+x, y0-y, x0+x, y0+y, color);
+			// Column x reaches rows up to -y, so the rows below
+			// that end at the previous column
+			for(;dy>-y;dy--) {
+				lcdFillSpan(dev, x0-dx, y0-dy, x0+dx, y0-dy, color);
+				lcdFillSpan(dev, x0-dx, y0+dy, x0+dx, y0+dy, color);
+			}
+			dx=x;
 		} // endif
 		ChangeX=(old_err=err)<=x;
 		if (ChangeX)            err+=++x*2+1;
 		if (old_err>y || err>x) err+=++y*2+1;
 	} while(y<=0);
+	for(;dy>0;dy--) {
+		lcdFillSpan(dev, x0-dx, y0-dy, x0+dx, y0-dy, color);
+		lcdFillSpan(dev, x0-dx, y0+dy, x0+dx, y0+dy, color);
+	}
+	lcdFillSpan(dev, x0-dx, y0, x0+dx, y0, color);
 } 
 
 // Draw rectangle with round corner
@@ -792,6 +1684,8 @@ void lcdDrawRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16
 	int err;
 	int old_err;
 	unsigned char temp;
+	ARC_RUN_t run;
+	ARC_RUN_t done;
 
 	if(x1>x2) {
 		temp=x1; x1=x2; x2=temp;
@@ -809,17 +1703,26 @@ void lcdDrawRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16
 	x=0;
 	y=-r;
 	err=2-2*r;
+	run.valid = false;
 
 	do{
 		if(x) {
-			lcdDrawPixel(dev, x1+r-x, y1+r+y, color); 
-			lcdDrawPixel(dev, x2-r+x, y1+r+y, color); 
-			lcdDrawPixel(dev, x1+r-x, y2-r-y, color); 
-			lcdDrawPixel(dev, x2-r+x, y2-r-y, color);
+			if (lcdArcStep(&run, x, y, &done)) {
+				lcdDrawArcRun(dev, &done, x1+r, y1+r, -1, 0, 0, 1, color);
+				lcdDrawArcRun(dev, &done, x2-r, y1+r, 1, 0, 0, 1, color);
+				lcdDrawArcRun(dev, &done, x1+r, y2-r, -1, 0, 0, -1, color);
+				lcdDrawArcRun(dev, &done, x2-r, y2-r, 1, 0, 0, -1, color);
+			}
 		} // endif 
 		if ((old_err=err)<=x)   err+=++x*2+1;
 		if (old_err>y || err>x) err+=++y*2+1;    
 	} while(y<0);
+	if (run.valid) {
+		lcdDrawArcRun(dev, &run, x1+r, y1+r, -1, 0, 0, 1, color);
+		lcdDrawArcRun(dev, &run, x2-r, y1+r, 1, 0, 0, 1, color);
+		lcdDrawArcRun(dev, &run, x1+r, y2-r, -1, 0, 0, -1, color);
+		lcdDrawArcRun(dev, &run, x2-r, y2-r, 1, 0, 0, -1, color);
+	}
 
 	ESP_LOGD(TAG, "x1+r=%d x2-r=%d",x1+r, x2-r);
 	lcdDrawLine(dev, x1+r,y1  ,x2-r,y1  ,color);
@@ -829,6 +1732,127 @@ void lcdDrawRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16
 	lcdDrawLine(dev, x2  ,y1+r,x2  ,y2-r,color);  
 } 
 
+// Draw rectangle of filling with round corner
+// x1:Start X coordinate
+// y1:Start Y coordinate
+// x2:End   X coordinate
+// y2:End   Y coordinate
+// r:radius
+// color:color
+// The corner rows are written as one span each and the middle as one rectangle.
+void lcdDrawFillRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t r, uint16_t color) {
+	int x;
+	int y;
+	int err;
+	int old_err;
+	int col;
+	int row;
+	uint16_t temp;
+
+	if(x1>x2) {
+		temp=x1; x1=x2; x2=temp;
+	} // endif
+	  
+	if(y1>y2) {
+		temp=y1; y1=y2; y2=temp;
+	} // endif
+
+	if (x2-x1 < r) return;
+	if (y2-y1 < r) return;
+
+	x=0;
+	y=-r;
+	err=2-2*r;
+
+	do{
+		col = x;
+		row = y;
+		if ((old_err=err)<=x)   err+=++x*2+1;
+		if (old_err>y || err>x) err+=++y*2+1;    
+		if (y != row) {
+			// The last point of a row is the widest one
+			lcdFillSpan(dev, x1+r-col, y1+r+row, x2-r+col, y1+r+row, color);
+			if (y2-r-row > y1+r+row) lcdFillSpan(dev, x1+r-col, y2-r-row, x2-r+col, y2-r-row, color);
+		}
+	} while(y<0);
+
+	if (y2-r >= y1+r) lcdDrawFillRect(dev, x1, y1+r, x2, y2-r, color);
+}
+
+// Draw triangle of filling
+// x0:First X coordinate
+// y0:First Y coordinate
+// x1:Second X coordinate
+// y1:Second Y coordinate
+// x2:Third X coordinate
+// y2:Third Y coordinate
+// color:color
+// Every row of the triangle is written once as a horizontal span.
+void lcdDrawFillTriangle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color) {
+	int px[3] = {x0, x1, x2};
+	int py[3] = {y0, y1, y2};
+	int temp;
+
+	// Sort the vertices by y
+	for(int i=0;i<2;i++) {
+		for(int j=0;j<2-i;j++) {
+			if (py[j] > py[j+1]) {
+				temp=py[j]; py[j]=py[j+1]; py[j+1]=temp;
+				temp=px[j]; px[j]=px[j+1]; px[j+1]=temp;
+			}
+		}
+	}
+
+	if (py[0] == py[2]) {
+		// All on one row
+		int xa = px[0];
+		int xb = px[0];
+		for(int i=1;i<3;i++) {
+			if (px[i] < xa) xa = px[i];
+			if (px[i] > xb) xb = px[i];
+		}
+		lcdFillSpan(dev, xa, py[0], xb, py[0], color);
+		return;
+	}
+
+	// Long edge 0-2 against the short edges 0-1 and 1-2
+	int dx02 = px[2] - px[0];
+	int dy02 = py[2] - py[0];
+	int dx01 = px[1] - px[0];
+	int dy01 = py[1] - py[0];
+	int dx12 = px[2] - px[1];
+	int dy12 = py[2] - py[1];
+	for(int y=py[0];y<=py[2];y++) {
+		int xa = px[0] + dx02 * (y - py[0]) / dy02;
+		int xb;
+		if (y < py[1]) {
+			xb = px[0] + dx01 * (y - py[0]) / dy01;
+		} else if (dy12 > 0) {
+			xb = px[1] + dx12 * (y - py[1]) / dy12;
+		} else {
+			xb = px[1];
+		}
+		lcdFillSpan(dev, xa, y, xb, y, color);
+	}
+}
+
+// Corners at the bottom of an arrow
+// Returns false when the arrow has no length.
+static bool lcdArrowBottom(int x0, int y0, int x1, int y1, int w, int * L, int * R) {
+	int Vx = x1 - x0;
+	int Vy = y1 - y0;
+	int v = lcdSqrt(Vx*Vx + Vy*Vy);
+	if (v == 0) return false;
+	// Bottom corners are w away from (x0,y0), perpendicular to the arrow
+	int Dx = (2*Vy*w + (Vy >= 0 ? v : -v)) / (2*v);
+	int Dy = (2*Vx*w + (Vx >= 0 ? v : -v)) / (2*v);
+	L[0] = x0 - Dx;
+	L[1] = y0 + Dy;
+	R[0] = x0 + Dx;
+	R[1] = y0 - Dy;
+	return true;
+}
+
 // Draw arrow
 // x0:Start X coordinate
 // y0:Start Y coordinate
@@ -838,18 +1862,8 @@ void lcdDrawRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16
 // color:color
 // Thanks http://k-hiura.cocolog-nifty.com/blog/2010/11/post-2a62.html
 void lcdDrawArrow(TFT_t * dev, uint16_t x0,uint16_t y0,uint16_t x1,uint16_t y1,uint16_t w,uint16_t color) {
-	double Vx= x1 - x0;
-	double Vy= y1 - y0;
-	double v = sqrt(Vx*Vx+Vy*Vy);
-	//   printf("v=%f\n",v);
-	double Ux= Vx/v;
-	double Uy= Vy/v;
-
-	uint16_t L[2],R[2];
-	L[0]= x1 - Uy*w - Ux*v;
-	L[1]= y1 + Ux*w - Uy*v;
-	R[0]= x1 + Uy*w - Ux*v;
-	R[1]= y1 - Ux*w - Uy*v;
+	int L[2],R[2];
+	if (lcdArrowBottom(x0, y0, x1, y1, w, L, R) == false) return;
 	//   printf("L=%d-%d R=%d-%d\n",L[0],L[1],R[0],R[1]);
 
 	//   lcdDrawLine(x0,y0,x1,y1,color);
@@ -867,35 +1881,12 @@ void lcdDrawArrow(TFT_t * dev, uint16_t x0,uint16_t y0,uint16_t x1,uint16_t y1,u
 // w:Width of the botom
 // color:color
 void lcdDrawFillArrow(TFT_t * dev, uint16_t x0,uint16_t y0,uint16_t x1,uint16_t y1,uint16_t w,uint16_t color) {
-	double Vx= x1 - x0;
-	double Vy= y1 - y0;
-	double v = sqrt(Vx*Vx+Vy*Vy);
-	//   printf("v=%f\n",v);
-	double Ux= Vx/v;
-	double Uy= Vy/v;
-
-	uint16_t L[2],R[2];
-	L[0]= x1 - Uy*w - Ux*v;
-	L[1]= y1 + Ux*w - Uy*v;
-	R[0]= x1 + Uy*w - Ux*v;
-	R[1]= y1 - Ux*w - Uy*v;
+	int L[2],R[2];
+	if (lcdArrowBottom(x0, y0, x1, y1, w, L, R) == false) return;
 	//   printf("L=%d-%d R=%d-%d\n",L[0],L[1],R[0],R[1]);
 
-	lcdDrawLine(dev, x0, y0, x1, y1, color);
-	lcdDrawLine(dev, x1, y1, L[0], L[1], color);
-	lcdDrawLine(dev, x1, y1, R[0], R[1], color);
-	lcdDrawLine(dev, L[0], L[1], R[0], R[1], color);
-
-	int ww;
-	for(ww=w-1;ww>0;ww--) {
-		L[0]= x1 - Uy*ww - Ux*v;
-		L[1]= y1 + Ux*ww - Uy*v;
-		R[0]= x1 + Uy*ww - Ux*v;
-		R[1]= y1 - Ux*ww - Uy*v;
-		//     printf("Fill>L=%d-%d R=%d-%d\n",L[0],L[1],R[0],R[1]);
-		lcdDrawLine(dev, x1, y1, L[0], L[1], color);
-		lcdDrawLine(dev, x1, y1, R[0], R[1], color);
-	}
+	// The shaft from (x0,y0) to (x1,y1) lies inside the head
+	lcdDrawFillTriangle(dev, x1, y1, L[0], L[1], R[0], R[1], color);
 }
 
 
@@ -906,143 +1897,313 @@ uint16_t rgb565_conv(uint16_t r,uint16_t g,uint16_t b) {
 	return (((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
 }
 
-// Draw ASCII character
+// RGB565 conversion in wire order
+// The bytes in memory are in the order they are sent to the panel,
+// for row sources in PIXEL_WIRE format.
+uint16_t rgb565_wire(uint16_t r,uint16_t g,uint16_t b) {
+	uint16_t color = rgb565_conv(r, g, b);
+	return (uint16_t)((color >> 8) | (color << 8));
+}
+
+// Screen position of a glyph pixel
+// h:Row in the glyph
+// col:Column in the glyph
+// (cx0,cy0) is the upper left corner of the character cell on the screen.
+static void lcdGlyphPoint(uint16_t dir, int cx0, int cy0, int pw, int ph, int h, int col, int * sx, int * sy) {
+	if (dir == 0) {
+		*sx = cx0 + col;
+		*sy = cy0 + h;
+	} else if (dir == 1) {
+		*sx = cx0 + ph - 1 - h;
+		*sy = cy0 + col;
+	} else if (dir == 2) {
+		*sx = cx0 + pw - 1 - col;
+		*sy = cy0 + ph - 1 - h;
+	} else {
+		*sx = cx0 + h;
+		*sy = cy0 + pw - 1 - col;
+	}
+}
+
+// Glyph bit at a position of a character band
+// i,j:Position in the band
+// glyphs:count patterns of gsize bytes, in the order they are drawn
+// scale:Each glyph pixel is a scale x scale block of the band
+// Returns whether the bit is set, and the glyph row in h.
+static bool lcdGlyphBit(uint16_t dir, const unsigned char * glyphs, int gsize, int count, int pw, int ph, int scale, int i, int j, int * h) {
+	int k, col;
+	if (scale > 1) {
+		i /= scale;
+		j /= scale;
+	}
+	if (dir == 0) {
+		k = i / pw;
+		*h = j; col = i % pw;
+	} else if (dir == 1) {
+		k = j / pw;
+		*h = ph - 1 - i; col = j % pw;
+	} else if (dir == 2) {
+		k = count - 1 - i / pw;
+		*h = ph - 1 - j; col = pw - 1 - i % pw;
+	} else {
+		k = count - 1 - j / pw;
+		*h = i; col = pw - 1 - j % pw;
+	}
+	const unsigned char * fonts = &glyphs[k * gsize];
+	return (fonts[*h * ((pw + 7) / 8) + col / 8] & (0x80 >> (col % 8))) != 0;
+}
+
+// Expand glyphs into RGB565 with foreground, background and underline
+// colors, and write them through one address window.
+// glyphs:count patterns of 128 bytes, in the order they are drawn
+// (cx0,cy0)-(cx0+cw-1,cy0+ch-1) is the band of all character cells,
+// scaled by the font scale.
+// The pixels are converted straight into the DMA buffers, several band
+// rows per transaction. A scaled glyph row is expanded once and copied
+// to the band rows it covers.
+// With a display list the glyphs are recorded, and the background is
+// left as it is when font fill is off.
+static void lcdDrawGlyphBand(TFT_t * dev, const unsigned char * glyphs, int count, int pw, int ph, int cx0, int cy0, int cw, int ch, uint16_t color) {
+	uint16_t dir = dev->_font_direction;
+	int scale = dev->_font_scale;
+	int rows = (SPI_BUFFER_SIZE / 2) / cw;
+
+	if (dev->_dl) {
+		int gsize = ((pw + 7) / 8) * ph;
+		void * data;
+		DL_CMD_t * cmd = lcdListAppend(dev, DL_GLYPH, cx0, cy0, cx0+cw-1, cy0+ch-1, color, count * gsize, &data);
+		for(int k=0;k<count;k++) {
+			memcpy((uint8_t *)data + k * gsize, &glyphs[k * 128], gsize);
+		}
+		cmd->u.glyph.count = count;
+		cmd->u.glyph.dir = dir;
+		cmd->u.glyph.pw = pw;
+		cmd->u.glyph.ph = ph;
+		cmd->u.glyph.scale = scale;
+		cmd->u.glyph.fill = dev->_font_fill;
+		cmd->u.glyph.underline = dev->_font_underline;
+		cmd->u.glyph.fill_color = dev->_font_fill_color;
+		cmd->u.glyph.underline_color = dev->_font_underline_color;
+		return;
+	}
+
+	lcdBeginPixels(dev, cx0, cy0, cx0+cw-1, cy0+ch-1);
+	for(int j0=0;j0<ch;j0+=rows) {
+		int j1 = j0 + rows;
+		if (j1 > ch) j1 = ch;
+		uint8_t * Byte = NULL;
+		if (dev->_fb == NULL) Byte = spi_master_get_buffer(dev);
+		int index = 0;
+		for(int j=j0;j<j1;j++) {
+			if (j % scale) {
+				// Same glyph row as the band row above
+				if (Byte == NULL) {
+					memcpy(&dev->_fb[(cy0 + j) * dev->_width + cx0], &dev->_fb[(cy0 + j - 1) * dev->_width + cx0], cw * 2);
+					continue;
+				}
+				if (j > j0) {
+					memcpy(&Byte[index], &Byte[index - cw * 2], cw * 2);
+					index += cw * 2;
+					continue;
+				}
+			}
+			for(int i=0;i<cw;i++) {
+				int h;
+				bool bit = lcdGlyphBit(dir, glyphs, 128, count, pw, ph, scale, i, j, &h);
+				uint16_t pixel = dev->_font_fill_color;
+				if (dev->_font_underline && h >= ph - 2) {
+					pixel = dev->_font_underline_color;
+				} else if (bit) {
+					pixel = color;
+				}
+				if (Byte == NULL) {
+					dev->_fb[(cy0 + j) * dev->_width + cx0 + i] = pixel;
+					continue;
+				}
+				Byte[index++] = (pixel >> 8) & 0xFF;
+				Byte[index++] = pixel & 0xFF;
+			}
+		}
+		if (Byte) spi_master_write_byte( dev, Byte, index, SPI_Data_Mode );
+	}
+	lcdEndPixels(dev);
+}
+
+// Draw SJIS character
 // x:X coordinate
 // y:Y coordinate
-// ascii: ascii code
+// sjis: SJIS code (ascii code below 0x100)
 // color:color
-int lcdDrawChar(TFT_t * dev, FontxFile *fxs, uint16_t x, uint16_t y, uint8_t ascii, uint16_t color) {
-	uint16_t xx,yy,bit,ofs;
-	unsigned char fonts[128]; // font pattern
+// With font fill the character cell is written as one block.
+// Otherwise each run of set bits in a glyph row is one span.
+int lcdDrawSJISChar(TFT_t * dev, FontxFile *fxs, uint16_t x, uint16_t y, uint16_t sjis, uint16_t color) {
+	LCD_STATS_CALL(dev, draw_char);
+	unsigned char buffer[128]; // font pattern
+	const unsigned char * fonts;
 	unsigned char pw, ph;
-	int h,w;
-	uint16_t mask;
-	bool rc;
+	int h,col;
 
 	if(_DEBUG_)printf("_font_direction=%d\n",dev->_font_direction);
-	rc = GetFontx(fxs, ascii, fonts, &pw, &ph);
-	if(_DEBUG_)printf("GetFontx rc=%d pw=%d ph=%d\n",rc,pw,ph);
-	if (!rc) return 0;
-
-	uint16_t xd1 = 0;
-	uint16_t yd1 = 0;
-	uint16_t xd2 = 0;
-	uint16_t yd2 = 0;
-	uint16_t xss = 0;
-	uint16_t yss = 0;
-	uint16_t xsd = 0;
-	uint16_t ysd = 0;
+	// Points into the font or the glyph cache when it can
+	fonts = GetFontxGlyph(fxs, sjis, buffer, &pw, &ph);
+	if(_DEBUG_)printf("GetFontxGlyph fonts=%p pw=%d ph=%d\n",fonts,pw,ph);
+	if (fonts == NULL) return 0;
+
+	// Character cell on the screen
+	int scale = dev->_font_scale;
+	int sw = pw * scale;
+	int sh = ph * scale;
+	int cx0 = 0;
+	int cy0 = 0;
+	int cw = 0;
+	int ch = 0;
 	int next = 0;
-        uint16_t x0  = 0;
-        uint16_t x1  = 0;
-        uint16_t y0  = 0;
-        uint16_t y1  = 0;
 	if (dev->_font_direction == 0) {
-		xd1 = +1;
-		yd1 = +1; //-1;
-		xd2 =  0;
-		yd2 =  0;
-		xss =  x;
-		yss =  y - (ph - 1);
-		xsd =  1;
-		ysd =  0;
-		next = x + pw;
-
-                x0  = x;
-                y0  = y - (ph-1);
-                x1  = x + (pw-1);
-                y1  = y;
+		cx0 = x;
+		cy0 = y - (sh - 1);
+		cw = sw;
+		ch = sh;
+		next = x + sw;
 	} else if (dev->_font_direction == 2) {
-		xd1 = -1;
-		yd1 = -1; //+1;
-		xd2 =  0;
-		yd2 =  0;
-		xss =  x;
-		yss =  y + ph + 1;
-		xsd =  1;
-		ysd =  0;
-		next = x - pw;
-
-                x0  = x - (pw-1);
-                y0  = y;
-                x1  = x;
-                y1  = y + (ph-1);
+		cx0 = x - (sw - 1);
+		cy0 = y + 2;
+		cw = sw;
+		ch = sh;
+		next = x - sw;
 	} else if (dev->_font_direction == 1) {
-		xd1 =  0;
-		yd1 =  0;
-		xd2 = -1;
-		yd2 = +1; //-1;
-		xss =  x + ph;
-		yss =  y;
-		xsd =  0;
-		ysd =  1;
-		next = y + pw; //y - pw;
-
-                x0  = x;
-                y0  = y;
-                x1  = x + (ph-1);
-                y1  = y + (pw-1);
+		cx0 = x + 1;
+		cy0 = y;
+		cw = sh;
+		ch = sw;
+		next = y + sw; //y - pw;
 	} else if (dev->_font_direction == 3) {
-		xd1 =  0;
-		yd1 =  0;
-		xd2 = +1;
-		yd2 = -1; //+1;
-		xss =  x - (ph - 1);
-		yss =  y;
-		xsd =  0;
-		ysd =  1;
-		next = y - pw; //y + pw;
-
-                x0  = x - (ph-1);
-                y0  = y - (pw-1);
-                x1  = x;
-                y1  = y;
-	}
-
-        if (dev->_font_fill) lcdDrawFillRect(dev, x0, y0, x1, y1, dev->_font_fill_color);
-
-	int bits;
-	if(_DEBUG_)printf("xss=%d yss=%d\n",xss,yss);
-	ofs = 0;
-	yy = yss;
-	xx = xss;
+		cx0 = x - (sh - 1);
+		cy0 = y - (sw - 1);
+		cw = sh;
+		ch = sw;
+		next = y - sw; //y + pw;
+	}
+	if (cw == 0) return 0;
+	if(_DEBUG_)printf("cx0=%d cy0=%d cw=%d ch=%d\n",cx0,cy0,cw,ch);
+
+	if ((dev->_font_fill || dev->_dl) && cx0 >= 0 && cy0 >= 0 && cx0 + cw <= dev->_width && cy0 + ch <= dev->_height
+		&& cw <= SPI_BUFFER_SIZE / 2) {
+		lcdDrawGlyphBand(dev, fonts, 1, pw, ph, cx0, cy0, cw, ch, color);
+		if (next < 0) next = 0;
+		return next;
+	}
+
+	if (dev->_font_fill) lcdFillSpan(dev, cx0, cy0, cx0+cw-1, cy0+ch-1, dev->_font_fill_color);
+
+	// A run of set bits in a glyph row is one block of scale rows
+	int bpr = (pw + 7) / 8;
+	int sx1, sy1, sx2, sy2;
 	for(h=0;h<ph;h++) {
-		if(xsd) xx = xss;
-		if(ysd) yy = yss;
-		//    for(w=0;w<(pw/8);w++) {
-		bits = pw;
-		for(w=0;w<((pw+4)/8);w++) {
-			mask = 0x80;
-			for(bit=0;bit<8;bit++) {
-				bits--;
-				if (bits < 0) continue;
-				//if(_DEBUG_)printf("xx=%d yy=%d mask=%02x fonts[%d]=%02x\n",xx,yy,mask,ofs,fonts[ofs]);
-				if (fonts[ofs] & mask) {
-					lcdDrawPixel(dev, xx, yy, color);
-				} else {
-					//if (dev->_font_fill) lcdDrawPixel(dev, xx, yy, dev->_font_fill_color);
-				}
-				if (h == (ph-2) && dev->_font_underline)
-					lcdDrawPixel(dev, xx, yy, dev->_font_underline_color);
-				if (h == (ph-1) && dev->_font_underline)
-					lcdDrawPixel(dev, xx, yy, dev->_font_underline_color);
-				xx = xx + xd1;
-				yy = yy + yd2;
-				mask = mask >> 1;
-			}
-			ofs++;
+		int h1 = h * scale;
+		int h2 = h1 + scale - 1;
+		if (dev->_font_underline && h >= ph - 2) {
+			lcdGlyphPoint(dev->_font_direction, cx0, cy0, sw, sh, h1, 0, &sx1, &sy1);
+			lcdGlyphPoint(dev->_font_direction, cx0, cy0, sw, sh, h2, sw-1, &sx2, &sy2);
+			lcdFillSpan(dev, sx1, sy1, sx2, sy2, dev->_font_underline_color);
+			continue;
+		}
+		const unsigned char * row = &fonts[h * bpr];
+		for(col=0;col<pw;col++) {
+			if ((row[col / 8] & (0x80 >> (col % 8))) == 0) continue;
+			int run = col;
+			while (col + 1 < pw && (row[(col+1) / 8] & (0x80 >> ((col+1) % 8)))) col++;
+			lcdGlyphPoint(dev->_font_direction, cx0, cy0, sw, sh, h1, run * scale, &sx1, &sy1);
+			lcdGlyphPoint(dev->_font_direction, cx0, cy0, sw, sh, h2, col * scale + scale - 1, &sx2, &sy2);
+			lcdFillSpan(dev, sx1, sy1, sx2, sy2, color);
 		}
-		yy = yy + yd1;
-		xx = xx + xd2;
 	}
 
 	if (next < 0) next = 0;
 	return next;
 }
 
+// Draw ASCII character
+// x:X coordinate
+// y:Y coordinate
+// ascii: ascii code
+// color:color
+int lcdDrawChar(TFT_t * dev, FontxFile *fxs, uint16_t x, uint16_t y, uint8_t ascii, uint16_t color) {
+	return lcdDrawSJISChar(dev, fxs, x, y, ascii, color);
+}
+
+// Draw a string with font fill (or into a display list) as one band
+// All glyphs are read first, and the band of character cells is written
+// through one address window.
+// The codes are ascii or, when it is NULL, sjis.
+// Returns false when the string can not be drawn this way.
+static bool lcdDrawStringBand(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, const uint8_t * ascii, const uint16_t * sjis, int length, uint16_t color, int * next) {
+	LCD_STATS_CALL(dev, draw_string);
+	unsigned char pw = 0, ph = 0;
+	unsigned char w, h;
+
+	if (length == 0) return false;
+	unsigned char * glyphs = malloc(length * 128);
+	if (glyphs == NULL) return false;
+	for(int i=0;i<length;i++) {
+		uint16_t code = ascii ? ascii[i] : sjis[i];
+		if (!GetFontx(fx, code, &glyphs[i * 128], &w, &h) || (i > 0 && (w != pw || h != ph))) {
+			free(glyphs);
+			return false;
+		}
+		pw = w;
+		ph = h;
+	}
+
+	// Band of all character cells on the screen
+	int sw = pw * dev->_font_scale;
+	int sh = ph * dev->_font_scale;
+	int cx0, cy0, cw, ch;
+	if (dev->_font_direction == 0) {
+		cx0 = x;
+		cy0 = y - (sh - 1);
+		cw = sw * length;
+		ch = sh;
+		*next = x + sw * length;
+	} else if (dev->_font_direction == 2) {
+		cx0 = x - (sw * length - 1);
+		cy0 = y + 2;
+		cw = sw * length;
+		ch = sh;
+		*next = x - sw * length;
+	} else if (dev->_font_direction == 1) {
+		cx0 = x + 1;
+		cy0 = y;
+		cw = sh;
+		ch = sw * length;
+		*next = y + sw * length;
+	} else if (dev->_font_direction == 3) {
+		cx0 = x - (sh - 1);
+		cy0 = y - (sw * length - 1);
+		cw = sh;
+		ch = sw * length;
+		*next = y - sw * length;
+	} else {
+		free(glyphs);
+		return false;
+	}
+	if(_DEBUG_)printf("band cx0=%d cy0=%d cw=%d ch=%d\n",cx0,cy0,cw,ch);
+
+	if (cx0 < 0 || cy0 < 0 || cx0 + cw > dev->_width || cy0 + ch > dev->_height || cw > SPI_BUFFER_SIZE / 2) {
+		free(glyphs);
+		return false;
+	}
+	lcdDrawGlyphBand(dev, glyphs, length, pw, ph, cx0, cy0, cw, ch, color);
+	LCD_STATS_ADD(dev, band_chars, length);
+	free(glyphs);
+	if (*next < 0) *next = 0;
+	return true;
+}
+
 int lcdDrawString(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t * ascii, uint16_t color) {
 	int length = strlen((char *)ascii);
 	if(_DEBUG_)printf("lcdDrawString length=%d\n",length);
+	int next;
+	if ((dev->_font_fill || dev->_dl) && lcdDrawStringBand(dev, fx, x, y, ascii, NULL, length, color, &next)) return next;
 	for(int i=0;i<length;i++) {
 		if(_DEBUG_)printf("ascii[%d]=%x x=%d y=%d\n",i,ascii[i],x,y);
 		if (dev->_font_direction == 0)
@@ -1062,125 +2223,16 @@ int lcdDrawString(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t *
 }
 
 
-#if 0
-// Draw SJIS character
-// x:X coordinate
-// y:Y coordinate
-// sjis: SJIS code
-// color:color
-int lcdDrawSJISChar(TFT_t * dev, FontxFile *fxs, uint16_t x,uint16_t y,uint16_t sjis,uint16_t color) {
-	uint16_t xx,yy,bit,ofs;
-	unsigned char fonts[128]; // font pattern
-	unsigned char pw, ph;
-	int h,w;
-	uint16_t mask;
-	bool rc;
-
-	if(_DEBUG_)printf("_font_direction=%d\n",dev->_font_direction);
-	//  sjis = UTF2SJIS(utf8);
-	//if(_DEBUG_)printf("sjis=%04x\n",sjis);
-
-	rc = GetFontx(fxs, sjis, fonts, &pw, &ph); // SJIS -> Font pattern
-	if(_DEBUG_)printf("GetFontx rc=%d pw=%d ph=%d\n",rc,pw,ph);
-	if (!rc) return 0;
-
-	uint16_t xd1, yd1;
-	uint16_t xd2, yd2;
-	uint16_t xss, yss;
-	uint16_t xsd, ysd;
-	int next;
-	if (dev->_font_direction == 0) {
-		xd1 = +1;
-		yd1 = -1;
-		xd2 =  0;
-		yd2 =  0;
-		xss =  x;
-		yss =  y + ph - 1;
-		xsd =  1;
-		ysd =  0;
-		next = x + pw;
-	} else if (dev->_font_direction == 2) {
-		xd1 = -1;
-		yd1 = +1;
-		xd2 =  0;
-		yd2 =  0;
-		xss =  x;
-		yss =  y - ph + 1;
-		xsd =  1;
-		ysd =  0;
-		next = x - pw;
-	} else if (dev->_font_direction == 1) {
-		xd1 =  0;
-		yd1 =  0;
-		xd2 = -1;
-		yd2 = -1;
-		xss =  x + ph;
-		yss =  y;
-		xsd =  0;
-		ysd =  1;
-		next = y - pw;
-	} else if (dev->_font_direction == 3) {
-		xd1 =  0;
-		yd1 =  0;
-		xd2 = +1;
-		yd2 = +1;
-		xss =  x - ph - 1;
-		yss =  y;
-		xsd =  0;
-		ysd =  1;
-		next = y + pw;
-	}
-
-	int bits;
-	if(_DEBUG_)printf("xss=%d yss=%d\n",xss,yss);
-	ofs = 0;
-	yy = yss;
-	xx = xss;
-	for(h=0;h<ph;h++) {
-		if(xsd) xx = xss;
-		if(ysd) yy = yss;
-		//    for(w=0;w<(pw/8);w++) {
-		bits = pw;
-		for(w=0;w<((pw+4)/8);w++) {
-			mask = 0x80;
-			for(bit=0;bit<8;bit++) {
-				bits--;
-				if (bits < 0) continue;
-				//if(_DEBUG_)printf("xx=%d yy=%d mask=%02x fonts[%d]=%02x\n",xx,yy,mask,ofs,fonts[ofs]);
-				if (fonts[ofs] & mask) {
-					lcdDrawPixel(dev, xx, yy, color);
-				} else {
-					if (dev->_font_fill) lcdDrawPixel(dev, xx, yy, dev->_font_fill_color);
-				}
-				if (h == (ph-2) && dev->_font_underline)
-					lcdDrawPixel(xx, yy, dev->_font_underline_color);
-				if (h == (ph-1) && dev->_font_underline)
-					lcdDrawPixel(xx, yy, dev->_font_underline_color);
-				xx = xx + xd1;
-				yy = yy + yd2;
-				mask = mask >> 1;
-			}
-			ofs++;
-		}
-		yy = yy + yd1;
-		xx = xx + xd2;
-	}
-
-	if (next < 0) next = 0;
-	return next;
-}
-
 // Draw UTF8 character
 // x:X coordinate
 // y:Y coordinate
 // utf8: UTF8 code
 // color:color
-int lcdDrawUTF8Char(TFT_t * dev, FontxFile *fx, uint16_t x,uint16_t y,uint8_t *utf8,uint16_t color) {
-	uint16_t sjis[1];
-
-	sjis[0] = UTF2SJIS(utf8);
-	if(_DEBUG_)printf("sjis=%04x\n",sjis[0]);
-	return lcdDrawSJISChar(dev, fx, x, y, sjis[0], color);
+int lcdDrawUTF8Char(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t *utf8, uint16_t color) {
+	uint16_t sjis = UTF2SJIS(utf8);
+	if(_DEBUG_)printf("sjis=%04x\n",sjis);
+	if (sjis == 0) sjis = '?';
+	return lcdDrawSJISChar(dev, fx, x, y, sjis, color);
 }
 
 // Draw UTF8 string
@@ -1188,15 +2240,25 @@ int lcdDrawUTF8Char(TFT_t * dev, FontxFile *fx, uint16_t x,uint16_t y,uint8_t *u
 // y:Y coordinate
 // utfs: UTF8 string
 // color:color
+// The string is converted with the table in memory; characters that
+// SJIS does not have are drawn as '?'.
 int lcdDrawUTF8String(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, unsigned char *utfs, uint16_t color) {
-
-	int i;
-	int spos;
-	uint16_t sjis[64];
-	spos = String2SJIS(utfs, strlen((char *)utfs), sjis, 64);
+	// A character has one code, so the string has as many codes as bytes at most
+	size_t bytes = strlen((char *)utfs);
+	uint16_t * sjis = malloc((bytes + 1) * sizeof(uint16_t));
+	if (sjis == NULL) {
+		ESP_LOGE(TAG, "lcdDrawUTF8String: no memory for %zu bytes", bytes);
+		return (dev->_font_direction == 1 || dev->_font_direction == 3) ? y : x;
+	}
+	int spos = String2SJIS(utfs, bytes, sjis, bytes);
 	if(_DEBUG_)printf("spos=%d\n",spos);
-	for(i=0;i<spos;i++) {
-		if(_DEBUG_)printf("sjis[%d]=%x y=%d\n",i,sjis[i],y);
+	int next;
+	if ((dev->_font_fill || dev->_dl) && lcdDrawStringBand(dev, fx, x, y, NULL, sjis, spos, color, &next)) {
+		free(sjis);
+		return next;
+	}
+	for(int i=0;i<spos;i++) {
+		if(_DEBUG_)printf("sjis[%d]=%x x=%d y=%d\n",i,sjis[i],x,y);
 		if (dev->_font_direction == 0)
 			x = lcdDrawSJISChar(dev, fx, x, y, sjis[i], color);
 		if (dev->_font_direction == 1)
@@ -1206,13 +2268,13 @@ int lcdDrawUTF8String(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, unsign
 		if (dev->_font_direction == 3)
 			y = lcdDrawSJISChar(dev, fx, x, y, sjis[i], color);
 	}
+	free(sjis);
 	if (dev->_font_direction == 0) return x;
 	if (dev->_font_direction == 2) return x;
 	if (dev->_font_direction == 1) return y;
 	if (dev->_font_direction == 3) return y;
 	return 0;
 }
-#endif
 
 // Set font direction
 // dir:Direction
@@ -1220,6 +2282,12 @@ void lcdSetFontDirection(TFT_t * dev, uint16_t dir) {
 	dev->_font_direction = dir;
 }
 
+// Set pixel format of row sources
+// format:PIXEL_HOST or PIXEL_WIRE
+void lcdSetPixelFormat(TFT_t * dev, uint16_t format) {
+	dev->_pixel_format = format;
+}
+
 // Set font filling
 // color:fill color
 void lcdSetFontFill(TFT_t * dev, uint16_t color) {
@@ -1244,18 +2312,457 @@ void lcdUnsetFontUnderLine(TFT_t * dev) {
 	dev->_font_underline = false;
 }
 
+// Set font scale
+// scale:Each glyph pixel is drawn as scale x scale pixels (1 to 4)
+// lcdDrawChar and the others return the position after the scaled cell.
+void lcdSetFontScale(TFT_t * dev, uint16_t scale) {
+	assert(scale >= 1 && scale <= 4);
+	dev->_font_scale = scale;
+}
+
+// UnSet font scale
+void lcdUnsetFontScale(TFT_t * dev) {
+	dev->_font_scale = 1;
+}
+
+// Queue transactions instead of waiting for each of them
+void lcdSetAsync(TFT_t * dev) {
+	dev->_async = true;
+}
+
+// Back to blocking transactions
+void lcdUnsetAsync(TFT_t * dev) {
+	spi_master_flush(dev);
+	dev->_async = false;
+}
+
+// Wait until all queued drawing is on the panel
+void lcdFence(TFT_t * dev) {
+	spi_master_flush(dev);
+}
+
+// Set the largest transfer sent by polling
+// bytes:Threshold in bytes (0:Always use the interrupt)
+void lcdSetPollingThreshold(TFT_t * dev, uint16_t bytes) {
+	dev->_polling_threshold = bytes;
+}
+
+// Drive the SPI bus from a flush task
+// core:Core the flush task is pinned to
+// Call this from the drawing task, which should run on the other core.
+// Drawing then only prepares pixels and hands the transfers to the
+// flush task, which waits for the bus. Use it with lcdSetAsync.
+// Returns false when the task cannot be created.
+bool lcdSetFlushTask(TFT_t * dev, int core) {
+	if (dev->_ring) return true;
+	struct SPI_RING * ring = heap_caps_malloc(sizeof(struct SPI_RING), MALLOC_CAP_8BIT);
+	if (ring == NULL) {
+		ESP_LOGW(TAG, "No memory for the flush task");
+		return false;
+	}
+	spi_master_flush(dev);
+	ring->taken = dev->_trans_queued;
+	ring->draw_task = xTaskGetCurrentTaskHandle();
+	ring->stop = false;
+	ring->stopped = false;
+	dev->_ring = ring;
+	// Higher than the drawing task, so the bus never waits for the producer
+	UBaseType_t priority = uxTaskPriorityGet(NULL) + 1;
+	if (xTaskCreatePinnedToCore(spi_master_flush_task, "LCDFLUSH", 1024*3, dev, priority, &ring->flush_task, core) != pdPASS) {
+		ESP_LOGW(TAG, "Cannot create the flush task");
+		dev->_ring = NULL;
+		heap_caps_free(ring);
+		return false;
+	}
+	return true;
+}
+
+// Stop the flush task and drive the SPI bus from the drawing task again
+void lcdUnsetFlushTask(TFT_t * dev) {
+	struct SPI_RING * ring = dev->_ring;
+	if (ring == NULL) return;
+	spi_master_flush(dev);
+	__atomic_store_n(&ring->stop, true, __ATOMIC_RELEASE);
+	xTaskNotifyGive(ring->flush_task);
+	while (__atomic_load_n(&ring->stopped, __ATOMIC_ACQUIRE) == false) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+	dev->_ring = NULL;
+	heap_caps_free(ring);
+}
+
+// Use a shadow frame buffer
+// All drawing goes to the frame buffer, and lcdFlush() sends the
+// changed parts to the panel. The buffer starts black, so the first
+// lcdFlush() writes the whole screen.
+// A copy of the last flushed frame is kept to find the changed tiles,
+// so this takes twice the size of the screen, from PSRAM if there is.
+// Returns false when there is no memory for the buffers.
+bool lcdSetFrameBuffer(TFT_t * dev) {
+	if (dev->_fb) return true;
+	if (dev->_dl) {
+		ESP_LOGW(TAG, "The display list is in use");
+		return false;
+	}
+	size_t size = dev->_width * dev->_height * sizeof(uint16_t);
+	int tiles = ((dev->_width + FB_TILE_SIZE - 1) / FB_TILE_SIZE) * ((dev->_height + FB_TILE_SIZE - 1) / FB_TILE_SIZE);
+	uint16_t * fb = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+	if (fb == NULL) fb = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+	uint16_t * last = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+	if (last == NULL) last = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+	if (fb == NULL || last == NULL) {
+		ESP_LOGW(TAG, "No memory for the frame buffer (2 x %zu bytes)", size);
+		heap_caps_free(fb);
+		heap_caps_free(last);
+		return false;
+	}
+	dev->_fb_dirty = heap_caps_calloc(tiles, sizeof(uint8_t), MALLOC_CAP_8BIT);
+	if (dev->_fb_dirty == NULL) {
+		ESP_LOGW(TAG, "No memory for the frame buffer tiles");
+		heap_caps_free(fb);
+		heap_caps_free(last);
+		return false;
+	}
+	dev->_fb_last = last;
+	memset(fb, 0, size);
+	dev->_fb = fb;
+	dev->_fb_full = true;
+	return true;
+}
+
+// Flush and go back to drawing on the panel directly
+void lcdUnsetFrameBuffer(TFT_t * dev) {
+	if (dev->_fb == NULL) return;
+	lcdFlush(dev);
+	heap_caps_free(dev->_fb);
+	heap_caps_free(dev->_fb_last);
+	heap_caps_free(dev->_fb_dirty);
+	dev->_fb = NULL;
+}
+
+// Compare a tile with the last flushed frame
+// The rows from the first changed one are copied to the last frame.
+// all:Copy the whole tile
+// Returns whether the tile changed.
+static bool lcdTileUpdate(TFT_t * dev, int tx, int ty, bool all) {
+	int x1 = tx * FB_TILE_SIZE;
+	int y1 = ty * FB_TILE_SIZE;
+	int x2 = x1 + FB_TILE_SIZE;
+	int y2 = y1 + FB_TILE_SIZE;
+	if (x2 > dev->_width) x2 = dev->_width;
+	if (y2 > dev->_height) y2 = dev->_height;
+	size_t bytes = (x2 - x1) * sizeof(uint16_t);
+	int y = y1;
+	if (!all) {
+		while (y < y2 && memcmp(&dev->_fb[y * dev->_width + x1], &dev->_fb_last[y * dev->_width + x1], bytes) == 0) y++;
+		if (y == y2) return false;
+	}
+	for(;y<y2;y++) {
+		memcpy(&dev->_fb_last[y * dev->_width + x1], &dev->_fb[y * dev->_width + x1], bytes);
+	}
+	return true;
+}
+
+// Record drawing in a display list
+// All drawing is recorded, and lcdFlush() rasterizes the list into two
+// small band buffers in turn, so one band is drawn while the other one
+// is on the wire. Every pixel under the recorded commands is sent once.
+// Pixels no command draws (such as the background of transparent text)
+// are not sent, and keep what is on the panel.
+// Returns false when there is no memory for the list.
+bool lcdSetDisplayList(TFT_t * dev) {
+	if (dev->_dl) return true;
+	if (dev->_fb) {
+		ESP_LOGW(TAG, "The frame buffer is in use");
+		return false;
+	}
+	struct DISPLAY_LIST * dl = heap_caps_malloc(sizeof(struct DISPLAY_LIST), MALLOC_CAP_8BIT);
+	if (dl == NULL) {
+		ESP_LOGW(TAG, "No memory for the display list");
+		return false;
+	}
+	dl->band[0] = heap_caps_malloc(dev->_width * DL_BAND_ROWS * sizeof(uint16_t), MALLOC_CAP_DMA);
+	dl->band[1] = heap_caps_malloc(dev->_width * DL_BAND_ROWS * sizeof(uint16_t), MALLOC_CAP_DMA);
+	dl->mask = heap_caps_malloc(dev->_width * DL_BAND_ROWS, MALLOC_CAP_8BIT);
+	dl->line = heap_caps_malloc(dev->_width * sizeof(uint16_t), MALLOC_CAP_8BIT);
+	if (dl->band[0] == NULL || dl->band[1] == NULL || dl->mask == NULL || dl->line == NULL) {
+		ESP_LOGW(TAG, "No memory for the display list bands");
+		heap_caps_free(dl->band[0]);
+		heap_caps_free(dl->band[1]);
+		heap_caps_free(dl->mask);
+		heap_caps_free(dl->line);
+		heap_caps_free(dl);
+		return false;
+	}
+	dl->count = 0;
+	dl->used = 0;
+	dl->band_seq[0] = dev->_trans_queued;
+	dl->band_seq[1] = dev->_trans_queued;
+	dev->_dl = dl;
+	return true;
+}
+
+// Flush and go back to drawing on the panel directly
+void lcdUnsetDisplayList(TFT_t * dev) {
+	struct DISPLAY_LIST * dl = dev->_dl;
+	if (dl == NULL) return;
+	lcdFlush(dev);
+	// The bands may still be on the wire
+	spi_master_flush(dev);
+	heap_caps_free(dl->band[0]);
+	heap_caps_free(dl->band[1]);
+	heap_caps_free(dl->mask);
+	heap_caps_free(dl->line);
+	heap_caps_free(dl);
+	dev->_dl = NULL;
+}
+
+#define SWAP16(c)	((uint16_t)(((c) >> 8) | ((c) << 8)))
+
+// Rasterize one command into the band (bx1,by1)-(bx2,by2) of width bw
+// Every pixel drawn is marked in the mask.
+static void lcdListRaster(TFT_t * dev, DL_CMD_t * cmd, uint16_t * band, int bx1, int by1, int bx2, int by2, int bw) {
+	struct DISPLAY_LIST * dl = dev->_dl;
+	int x1 = (cmd->x1 > bx1) ? cmd->x1 : bx1;
+	int x2 = (cmd->x2 < bx2) ? cmd->x2 : bx2;
+	int y1 = (cmd->y1 > by1) ? cmd->y1 : by1;
+	int y2 = (cmd->y2 < by2) ? cmd->y2 : by2;
+
+	if (cmd->type == DL_RECT) {
+		uint16_t color = SWAP16(cmd->color);
+		for(int y=y1;y<=y2;y++) {
+			uint16_t * line = &band[(y - by1) * bw - bx1];
+			for(int x=x1;x<=x2;x++) line[x] = color;
+			memset(&dl->mask[(y - by1) * bw + x1 - bx1], 1, x2 - x1 + 1);
+		}
+
+	} else if (cmd->type == DL_PIXELS) {
+		uint16_t * colors = (uint16_t *)&dl->arena[cmd->data];
+		uint32_t width = cmd->x2 - cmd->x1 + 1;
+		uint32_t height = cmd->y2 - cmd->y1 + 1;
+		for(int i=0;i<cmd->u.pixels.size;i++) {
+			uint32_t pos = cmd->u.pixels.start + i;
+			int x = cmd->x1 + pos % width;
+			int y = cmd->y1 + (pos / width) % height;
+			if (y < y1 || y > y2) continue;
+			band[(y - by1) * bw + x - bx1] = SWAP16(colors[i]);
+			dl->mask[(y - by1) * bw + x - bx1] = 1;
+		}
+
+	} else if (cmd->type == DL_GLYPH) {
+		unsigned char * glyphs = &dl->arena[cmd->data];
+		int pw = cmd->u.glyph.pw;
+		int ph = cmd->u.glyph.ph;
+		int gsize = ((pw + 7) / 8) * ph;
+		for(int y=y1;y<=y2;y++) {
+			uint16_t * line = &band[(y - by1) * bw - bx1];
+			uint8_t * mask = &dl->mask[(y - by1) * bw - bx1];
+			for(int x=x1;x<=x2;x++) {
+				int h;
+				bool bit = lcdGlyphBit(cmd->u.glyph.dir, glyphs, gsize, cmd->u.glyph.count, pw, ph, cmd->u.glyph.scale, x - cmd->x1, y - cmd->y1, &h);
+				if (cmd->u.glyph.underline && h >= ph - 2) {
+					line[x] = SWAP16(cmd->u.glyph.underline_color);
+				} else if (bit) {
+					line[x] = SWAP16(cmd->color);
+				} else if (cmd->u.glyph.fill) {
+					line[x] = SWAP16(cmd->u.glyph.fill_color);
+				} else {
+					continue;
+				}
+				mask[x] = 1;
+			}
+		}
+
+	} else if (cmd->type == DL_SOURCE) {
+		uint16_t width = cmd->x2 - cmd->x1 + 1;
+		bool direct = cmd->u.source.wire && x1 == cmd->x1 && x2 == cmd->x2;
+		for(int y=y1;y<=y2;y++) {
+			uint16_t * line = &band[(y - by1) * bw - bx1];
+			if (direct) {
+				// Wire order rows go straight into the band
+				cmd->u.source.func(cmd->u.source.arg, y - cmd->y1, &line[x1], width);
+			} else {
+				cmd->u.source.func(cmd->u.source.arg, y - cmd->y1, dl->line, width);
+				if (cmd->u.source.wire) {
+					memcpy(&line[x1], &dl->line[x1 - cmd->x1], (x2 - x1 + 1) * 2);
+				} else {
+					for(int x=x1;x<=x2;x++) line[x] = SWAP16(dl->line[x - cmd->x1]);
+				}
+			}
+			memset(&dl->mask[(y - by1) * bw + x1 - bx1], 1, x2 - x1 + 1);
+		}
+	}
+}
+
+// Send pixels of a band through one address window
+static void lcdListSend(TFT_t * dev, uint16_t * pixels, int x1, int y1, int x2, int y2) {
+	lcdPanelBeginPixels(dev, x1, y1, x2, y2);
+	uint8_t * Byte = (uint8_t *)pixels;
+	uint32_t bytes = (x2 - x1 + 1) * (y2 - y1 + 1) * sizeof(uint16_t);
+	while (bytes > 0) {
+		uint32_t length = bytes;
+		if (length > SPI_FILL_PIXELS * 2) length = SPI_FILL_PIXELS * 2;
+		spi_master_write_byte( dev, Byte, length, SPI_Data_Mode );
+		Byte = Byte + length;
+		bytes = bytes - length;
+	}
+	lcdPanelEndPixels(dev);
+}
+
+// Replay the display list band by band
+static void lcdFlushDisplayList(TFT_t * dev) {
+	struct DISPLAY_LIST * dl = dev->_dl;
+	if (dl->count == 0) return;
+
+	int b = 0;
+	for(int y1=0;y1<dev->_height;y1+=DL_BAND_ROWS) {
+		int y2 = y1 + DL_BAND_ROWS - 1;
+		if (y2 >= dev->_height) y2 = dev->_height - 1;
+
+		// Only the bounding box of the commands in this band is sent
+		int bx1 = dev->_width;
+		int bx2 = -1;
+		int by1 = y2 + 1;
+		int by2 = y1 - 1;
+		for(int i=0;i<dl->count;i++) {
+			DL_CMD_t * cmd = &dl->cmd[i];
+			if (cmd->y2 < y1 || cmd->y1 > y2) continue;
+			if (cmd->x1 < bx1) bx1 = cmd->x1;
+			if (cmd->x2 > bx2) bx2 = cmd->x2;
+			if (cmd->y1 < by1) by1 = cmd->y1;
+			if (cmd->y2 > by2) by2 = cmd->y2;
+		}
+		if (bx2 < 0) continue;
+		if (by1 < y1) by1 = y1;
+		if (by2 > y2) by2 = y2;
+		int bw = bx2 - bx1 + 1;
+		int bh = by2 - by1 + 1;
+
+		// Wait until the band sent two bands ago has left this buffer
+		while ((int32_t)(spi_master_done(dev) - dl->band_seq[b]) < 0) {
+			spi_master_collect(dev);
+		}
+		uint16_t * band = dl->band[b];
+		memset(dl->mask, 0, bw * bh);
+		for(int i=0;i<dl->count;i++) {
+			DL_CMD_t * cmd = &dl->cmd[i];
+			if (cmd->y2 < by1 || cmd->y1 > by2) continue;
+			lcdListRaster(dev, cmd, band, bx1, by1, bx2, by2, bw);
+		}
+
+		// Send the whole band at once when every pixel was drawn,
+		// otherwise only the runs of drawn pixels in each row
+		if (memchr(dl->mask, 0, bw * bh) == NULL) {
+			lcdListSend(dev, band, bx1, by1, bx2, by2);
+		} else {
+			for(int y=by1;y<=by2;y++) {
+				uint8_t * mask = &dl->mask[(y - by1) * bw];
+				for(int x=0;x<bw;) {
+					if (mask[x] == 0) {
+						x++;
+						continue;
+					}
+					int run = x;
+					while (x < bw && mask[x]) x++;
+					lcdListSend(dev, &band[(y - by1) * bw + run], bx1 + run, y, bx1 + x - 1, y);
+				}
+			}
+		}
+		dl->band_seq[b] = dev->_trans_queued;
+		b = 1 - b;
+	}
+	dl->count = 0;
+	dl->used = 0;
+}
+
+// Send the changed parts of the frame buffer to the panel
+// Drawn tiles are compared with the last flushed frame, and the tiles
+// that really changed are merged into rectangles.
+void lcdFlush(TFT_t * dev) {
+	if (dev->_dl) {
+		lcdFlushDisplayList(dev);
+		return;
+	}
+	if (dev->_fb == NULL) return;
+	int tiles_x = (dev->_width + FB_TILE_SIZE - 1) / FB_TILE_SIZE;
+	int tiles_y = (dev->_height + FB_TILE_SIZE - 1) / FB_TILE_SIZE;
+	uint8_t * dirty = dev->_fb_dirty;
+
+	int changed = 0;
+	for(int ty=0;ty<tiles_y;ty++) {
+		for(int tx=0;tx<tiles_x;tx++) {
+			int t = ty * tiles_x + tx;
+			if (!dirty[t] && !dev->_fb_full) continue;
+			if (!lcdTileUpdate(dev, tx, ty, dev->_fb_full)) {
+				dirty[t] = 0;
+				continue;
+			}
+			dirty[t] = 1;
+			changed++;
+		}
+	}
+	dev->_fb_full = false;
+	ESP_LOGD(TAG, "lcdFlush changed tiles=%d", changed);
+	if (changed == 0) return;
+
+	// Grow each changed tile to the right, then down, into a rectangle
+	for(int ty=0;ty<tiles_y;ty++) {
+		for(int tx=0;tx<tiles_x;tx++) {
+			if (!dirty[ty * tiles_x + tx]) continue;
+			int tx2 = tx;
+			while (tx2 + 1 < tiles_x && dirty[ty * tiles_x + tx2 + 1]) tx2++;
+			int ty2 = ty;
+			bool full_row = true;
+			while (ty2 + 1 < tiles_y && full_row) {
+				for(int i=tx;i<=tx2;i++) {
+					if (!dirty[(ty2 + 1) * tiles_x + i]) full_row = false;
+				}
+				if (full_row) ty2++;
+			}
+			for(int j=ty;j<=ty2;j++) {
+				memset(&dirty[j * tiles_x + tx], 0, tx2 - tx + 1);
+			}
+
+			int x1 = tx * FB_TILE_SIZE;
+			int y1 = ty * FB_TILE_SIZE;
+			int x2 = (tx2 + 1) * FB_TILE_SIZE - 1;
+			int y2 = (ty2 + 1) * FB_TILE_SIZE - 1;
+			if (x2 >= dev->_width) x2 = dev->_width - 1;
+			if (y2 >= dev->_height) y2 = dev->_height - 1;
+			ESP_LOGD(TAG, "lcdFlush x1=%d y1=%d x2=%d y2=%d", x1, y1, x2, y2);
+			lcdPanelBeginPixels(dev, x1, y1, x2, y2);
+			// Rows are packed back to back into the DMA buffers
+			uint8_t * Byte = NULL;
+			int index = 0;
+			for(int y=y1;y<=y2;y++) {
+				uint16_t * line = &dev->_fb[y * dev->_width];
+				for(int x=x1;x<=x2;x++) {
+					if (Byte == NULL) {
+						Byte = spi_master_get_buffer(dev);
+						index = 0;
+					}
+					Byte[index++] = (line[x] >> 8) & 0xFF;
+					Byte[index++] = line[x] & 0xFF;
+					if (index == SPI_BUFFER_SIZE) {
+						spi_master_write_byte( dev, Byte, index, SPI_Data_Mode );
+						Byte = NULL;
+					}
+				}
+			}
+			if (Byte) spi_master_write_byte( dev, Byte, index, SPI_Data_Mode );
+			lcdPanelEndPixels(dev);
+		}
+	}
+}
+
 // Backlight OFF
 void lcdBacklightOff(TFT_t * dev) {
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 0 );
-	}
+	dev->_transport->backlight( dev->_transport_ctx, 0 );
 }
 
 // Backlight ON
 void lcdBacklightOn(TFT_t * dev) {
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 1 );
-	}
+	dev->_transport->backlight( dev->_transport_ctx, 1 );
 }
 
 // Vertical Scrolling Definition
@@ -1263,7 +2770,7 @@ void lcdBacklightOn(TFT_t * dev) {
 // vsa:Vertical Scrolling Area
 // bfa:Bottom Fixed Area
 void lcdSetScrollArea(TFT_t * dev, uint16_t tfa, uint16_t vsa, uint16_t bfa){
-	if (dev->_model == 0x9340 || dev->_model == 0x9341) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
 		spi_master_write_comm_byte(dev, 0x33);	// Vertical Scrolling Definition
 		spi_master_write_data_word(dev, tfa);
 		spi_master_write_data_word(dev, vsa);
@@ -1271,7 +2778,7 @@ void lcdSetScrollArea(TFT_t * dev, uint16_t tfa, uint16_t vsa, uint16_t bfa){
 		//spi_master_write_comm_byte(dev, 0x12);	// Partial Mode ON
 	} // endif 0x9340/0x9341
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x31, vsa);	// Specify scroll end and step at the scroll display
 		lcdWriteRegisterByte(dev, 0x32, tfa);	// Specify scroll start and step at the scroll display
 #if 0
@@ -1284,14 +2791,14 @@ void lcdSetScrollArea(TFT_t * dev, uint16_t tfa, uint16_t vsa, uint16_t bfa){
 }
 
 void lcdResetScrollArea(TFT_t * dev){
-	if (dev->_model == 0x9340 || dev->_model == 0x9341) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
 		spi_master_write_comm_byte(dev, 0x33);	// Vertical Scrolling Definition
 		spi_master_write_data_word(dev, 0);
 		spi_master_write_data_word(dev, 0x140);
 		spi_master_write_data_word(dev, 0);
 	} // endif 0x9340/0x9341
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x31, 0x0);	// Specify scroll end and step at the scroll display
 		lcdWriteRegisterByte(dev, 0x32, 0x0);	// Specify scroll start and step at the scroll display
 		//lcdWriteRegisterByte(dev, 0x31, vsa);	// Specify scroll end and step at the scroll display
@@ -1302,12 +2809,12 @@ void lcdResetScrollArea(TFT_t * dev){
 // Vertical Scrolling Start Address
 // vsp:Vertical Scrolling Start Address
 void lcdScroll(TFT_t * dev, uint16_t vsp){
-	if (dev->_model == 0x9340 || dev->_model == 0x9341) {
+	if (lcdModel(dev) == 0x9340 || lcdModel(dev) == 0x9341) {
 		spi_master_write_comm_byte(dev, 0x37);	// Vertical Scrolling Start Address
 		spi_master_write_data_word(dev, vsp);
 	} // endif 0x9340/0x9341
 
-	if (dev->_model == 0x9225 || dev->_model == 0x9226) {
+	if (lcdModel(dev) == 0x9225 || lcdModel(dev) == 0x9226) {
 		lcdWriteRegisterByte(dev, 0x33, vsp);	// Vertical Scrolling Start Address
 #if 0
 		spi_master_write_comm_byte(dev, 0x33);	// Vertical Scrolling Start Address
@@ -1316,3 +2823,213 @@ void lcdScroll(TFT_t * dev, uint16_t vsp){
 	} // endif 0x9225/0x9226
 }
 
+// A page of the marquee, as wide as the screen at most
+typedef struct {
+	uint16_t start;	// First character
+	uint16_t count;	// Number of characters
+	uint16_t x;	// Left edge on the screen
+} MARQUEE_PAGE_t;
+
+// String rolling up through a band of the screen
+// The band is the vertical scrolling area, so the panel moves it when
+// VSCRSADD changes. The band shows rows row..ph-1 of the shown page
+// above rows 0..row-1 of the next one, and GRAM row y+row is the one
+// that wraps around next.
+struct MARQUEE {
+	unsigned char * glyphs;	// 128 bytes per character
+	MARQUEE_PAGE_t * page;
+	int pages;
+	int shown;
+	int row;
+	int pw;
+	int ph;
+	uint16_t y;	// Top of the band
+	uint16_t color;
+	uint16_t back;
+	uint16_t * line;
+};
+
+// Expand one row of a page into the line buffer, over x1..x2
+static void lcdMarqueeRow(struct MARQUEE * mq, int page, int j, uint16_t x1, uint16_t x2) {
+	MARQUEE_PAGE_t * p = &mq->page[page];
+	int h;
+	for(int x=x1;x<=x2;x++) {
+		int i = x - p->x;
+		bool bit = i >= 0 && i < p->count * mq->pw
+			&& lcdGlyphBit(0, &mq->glyphs[p->start * 128], 128, p->count, mq->pw, mq->ph, 1, i, j, &h);
+		mq->line[x - x1] = bit ? mq->color : mq->back;
+	}
+}
+
+// Draw a whole page into the band, top row first in GRAM
+static void lcdMarqueeDrawPage(TFT_t * dev, int page) {
+	struct MARQUEE * mq = dev->_marquee;
+	for(int j=0;j<mq->ph;j++) {
+		lcdMarqueeRow(mq, page, j, 0, dev->_width-1);
+		lcdDrawMultiPixels(dev, 0, mq->y + j, dev->_width, mq->line);
+	}
+}
+
+// Roll a string through the band of one text line
+// y:Y coordinate of the baseline, as lcdDrawString with DIRECTION0
+// utfs:UTF8 string, split into pages at spaces where it does not fit the width
+// color:Text color. The background is the font fill color, or black.
+// The band becomes the vertical scrolling area, which spans the whole
+// width of the screen. Do not draw into the band until lcdUnsetMarquee.
+// The panel scrolls along GRAM rows, which are the rows of the screen
+// only with DIRECTION0 rotation and no Y offset.
+// Returns false when the string fits the width, or the panel can not scroll.
+bool lcdSetMarquee(TFT_t * dev, FontxFile *fx, uint16_t y, uint8_t * utfs, uint16_t color) {
+	if (lcdModel(dev) != 0x9340 && lcdModel(dev) != 0x9341) return false;
+	if (dev->_rotation != DIRECTION0 || dev->_offsety != 0) return false;
+	if (dev->_marquee) return false;
+	size_t bytes = strlen((char *)utfs);
+	if (bytes == 0) return false;
+
+	// A character has one code, as in lcdDrawUTF8String
+	uint16_t * sjis = malloc(bytes * sizeof(uint16_t));
+	if (sjis == NULL) return false;
+	int length = String2SJIS(utfs, bytes, sjis, bytes);
+
+	struct MARQUEE * mq = calloc(1, sizeof(struct MARQUEE));
+	if (mq == NULL) {
+		free(sjis);
+		return false;
+	}
+	mq->glyphs = malloc(length * 128);
+	mq->page = malloc(length * sizeof(MARQUEE_PAGE_t));
+	mq->line = malloc(dev->_width * sizeof(uint16_t));
+	if (mq->glyphs == NULL || mq->page == NULL || mq->line == NULL) goto fail;
+
+	unsigned char w, h;
+	for(int i=0;i<length;i++) {
+		if (!GetFontx(fx, sjis[i], &mq->glyphs[i * 128], &w, &h)) goto fail;
+		if (i > 0 && (w != mq->pw || h != mq->ph)) goto fail;
+		mq->pw = w;
+		mq->ph = h;
+	}
+	if (y < mq->ph - 1 || y >= dev->_height) goto fail;
+
+	// Split into pages, breaking at the last space that fits
+	int columns = dev->_width / mq->pw;
+	if (columns == 0) goto fail;
+	int start = 0;
+	while (start < length) {
+		int count = length - start;
+		if (count > columns) {
+			count = columns;
+			for(int i=columns;i>0;i--) {
+				if (sjis[start + i] == ' ') {
+					count = i;
+					break;
+				}
+			}
+		}
+		MARQUEE_PAGE_t * p = &mq->page[mq->pages++];
+		p->start = start;
+		p->count = count;
+		p->x = (dev->_width - count * mq->pw) / 2;
+		start += count;
+		while (start < length && sjis[start] == ' ') start++;
+	}
+	if (mq->pages < 2) goto fail;
+
+	free(sjis);
+	mq->y = y - (mq->ph - 1);
+	mq->color = color;
+	mq->back = dev->_font_fill ? dev->_font_fill_color : BLACK;
+	dev->_marquee = mq;
+	lcdMarqueeDrawPage(dev, 0);
+	lcdSetScrollArea(dev, mq->y, mq->ph, dev->_height - mq->y - mq->ph);
+	lcdScroll(dev, mq->y);
+	return true;
+
+fail:
+	free(sjis);
+	free(mq->glyphs);
+	free(mq->page);
+	free(mq->line);
+	free(mq);
+	return false;
+}
+
+// Roll the marquee up by one row
+// Only the row that wraps around to the bottom of the band is sent,
+// over the columns where either page has text, and then VSCRSADD.
+// Returns true when the next page has rolled in completely.
+bool lcdMarqueeScroll(TFT_t * dev) {
+	struct MARQUEE * mq = dev->_marquee;
+	if (mq == NULL) return false;
+	int next = (mq->shown + 1) % mq->pages;
+	MARQUEE_PAGE_t * a = &mq->page[mq->shown];
+	MARQUEE_PAGE_t * b = &mq->page[next];
+	uint16_t x1 = (a->x < b->x) ? a->x : b->x;
+	uint16_t x2 = (a->count > b->count) ? a->x + a->count * mq->pw - 1 : b->x + b->count * mq->pw - 1;
+
+	uint16_t y = mq->y + mq->row;
+	lcdMarqueeRow(mq, next, mq->row, x1, x2);
+	if (dev->_fb) {
+		// Write the row through the frame buffer, rather than sending
+		// every tile it touches on the next flush
+		lcdFlush(dev);
+		memcpy(&dev->_fb[y * dev->_width + x1], mq->line, (x2 - x1 + 1) * 2);
+		memcpy(&dev->_fb_last[y * dev->_width + x1], mq->line, (x2 - x1 + 1) * 2);
+		spi_master_write_window(dev, x1 + dev->_offsetx, y + dev->_offsety, x2 + dev->_offsetx, y + dev->_offsety);
+		spi_master_write_colors(dev, mq->line, x2 - x1 + 1);
+	} else {
+		lcdDrawMultiPixels(dev, x1, y, x2 - x1 + 1, mq->line);
+		lcdFlush(dev);
+	}
+	mq->row++;
+	lcdScroll(dev, mq->y + (mq->row % mq->ph));
+	if (mq->row < mq->ph) return false;
+	mq->row = 0;
+	mq->shown = next;
+	return true;
+}
+
+// Stop the marquee and leave the shown page in the band
+void lcdUnsetMarquee(TFT_t * dev) {
+	struct MARQUEE * mq = dev->_marquee;
+	if (mq == NULL) return;
+	lcdSetScrollArea(dev, 0, dev->_height, 0);
+	lcdScroll(dev, 0);
+	if (mq->row) lcdMarqueeDrawPage(dev, mq->shown);
+	lcdFlush(dev);
+	dev->_marquee = NULL;
+	free(mq->glyphs);
+	free(mq->page);
+	free(mq->line);
+	free(mq);
+}
+
+#if LCD_STATS
+static void lcdDumpCall(const char * name, LCD_CALL_STATS_t * call) {
+	uint64_t average = call->count ? call->cycles / call->count : 0;
+	ESP_LOGI(TAG, "%-18s calls=%"PRIu32" cycles=%"PRIu64" (%"PRIu64"/call)", name, call->count, call->cycles, average);
+}
+
+// Log the counters
+void lcdDumpStats(TFT_t * dev) {
+	LCD_STATS_t * stats = &dev->_stats;
+	ESP_LOGI(TAG, "transactions=%"PRIu32" bytes=%"PRIu64" commands=%"PRIu32" windows=%"PRIu32,
+		stats->transactions, stats->bytes, stats->commands, stats->windows);
+	ESP_LOGI(TAG, "blocked cycles=%"PRIu64" polling=%"PRIu32" interrupt=%"PRIu32,
+		stats->blocked_cycles, dev->_polling_count, dev->_interrupt_count);
+	lcdDumpCall("lcdDrawPixel", &stats->draw_pixel);
+	lcdDumpCall("lcdDrawMultiPixels", &stats->draw_multi_pixels);
+	lcdDumpCall("lcdDrawFillRect", &stats->draw_fill_rect);
+	lcdDumpCall("lcdDrawChar", &stats->draw_char);
+	lcdDumpCall("lcdDrawStringBand", &stats->draw_string);
+	ESP_LOGI(TAG, "band characters=%"PRIu32, stats->band_chars);
+}
+
+// Clear the counters
+void lcdResetStats(TFT_t * dev) {
+	memset(&dev->_stats, 0, sizeof(dev->_stats));
+	dev->_polling_count = 0;
+	dev->_interrupt_count = 0;
+	dev->_window_count = 0;
+	dev->_window_skip = 0;
+}
+#endif
@@ -1,9 +1,22 @@
 #ifndef _ILI9340_H_
 #define _ILI9340_H_
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
 #include "driver/spi_master.h"
+#endif
 #include "fontx.h"
 
+// Count SPI transfers and drawing calls in every TFT_t
+// Set by CONFIG_ESP_LCD_STATS, or by defining LCD_STATS.
+#if CONFIG_ESP_LCD_STATS && !defined(LCD_STATS)
+#define LCD_STATS 1
+#endif
+
 #define RED			0xf800
 #define GREEN			0x07e0
 #define BLUE			0x001f
@@ -20,31 +33,151 @@
 #define DIRECTION180		2
 #define DIRECTION270		3
 
+#define PIXEL_HOST		0
+#define PIXEL_WIRE		1
+
+#define SPI_QUEUE_SIZE		16
+#define SPI_RING_SIZE		32
+#define SPI_RING_INLINE		16
+#define SPI_BUFFER_COUNT	2
+#define SPI_BUFFER_SIZE		1024
+#define SPI_POLLING_THRESHOLD	16
+#define SPI_FILL_PIXELS		4096
+#define FB_TILE_SIZE		16
+#define DL_BAND_ROWS		16
+#define DL_COMMANDS		512
+#define DL_ARENA_SIZE		8192
+
+// Source of image rows for lcdDrawRowSource
+// row:Row number in the image (0 is the top row)
+// colors:Receives the colors of the row
+// width:Number of colors to write, from the left of the row
+// The colors are in the format set by lcdSetPixelFormat.
+typedef void (*lcdRowSource_t)(void * arg, uint16_t row, uint16_t * colors, uint16_t width);
+
+#if LCD_STATS
+// Calls of a drawing primitive
+typedef struct {
+	uint32_t count;
+	uint64_t cycles;		// Including the primitives it calls
+} LCD_CALL_STATS_t;
+
+// Counters of a TFT_t, see lcdDumpStats
+typedef struct {
+	uint32_t transactions;		// Transfers handed to the transport
+	uint64_t bytes;
+	uint32_t commands;		// Transfers with DC low
+	uint32_t windows;		// Address windows set
+	uint64_t blocked_cycles;	// Waiting for the transport
+	LCD_CALL_STATS_t draw_pixel;
+	LCD_CALL_STATS_t draw_multi_pixels;
+	LCD_CALL_STATS_t draw_fill_rect;
+	LCD_CALL_STATS_t draw_char;
+	LCD_CALL_STATS_t draw_string;	// Strings tried as one band
+	uint32_t band_chars;		// Characters drawn in a band
+} LCD_STATS_t;
+#endif
+
+struct DISPLAY_LIST;
+struct SPI_RING;
+struct MARQUEE;
+
+// Transport to the panel
+// All functions get the ctx given to lcdInitTransport.
+// dc:0 for a command, 1 for data
+typedef struct {
+	// Send by polling and return when the bytes are on the wire
+	void (*polling)(void * ctx, const uint8_t * data, size_t length, int16_t dc);
+	// Send and wait for the end of the transfer
+	void (*transmit)(void * ctx, const uint8_t * data, size_t length, int16_t dc);
+	// Start a transfer. At most SPI_QUEUE_SIZE are in flight, and
+	// data is not touched after result() unless it is 4 bytes or less.
+	void (*queue)(void * ctx, const uint8_t * data, size_t length, int16_t dc);
+	// Wait for the oldest transfer started by queue()
+	void (*result)(void * ctx);
+	// Drive the backlight (0:Off 1:On)
+	void (*backlight)(void * ctx, int level);
+} LCD_TRANSPORT_t;
+
 typedef struct {
 	uint16_t _model;
 	uint16_t _width;
 	uint16_t _height;
 	uint16_t _offsetx;
 	uint16_t _offsety;
+	uint16_t _gram_width;
+	uint16_t _gram_height;
+	uint16_t _rotation;
+	uint16_t _madctl;
 	uint16_t _font_direction;
 	uint16_t _font_fill;
 	uint16_t _font_fill_color;
 	uint16_t _font_underline;
 	uint16_t _font_underline_color;
+	uint16_t _font_scale;
+	uint16_t _pixel_format;
 	int16_t _dc;
 	int16_t _bl;
-	spi_device_handle_t _SPIHandle;
+	const LCD_TRANSPORT_t * _transport;
+	void * _transport_ctx;
+	bool _async;
+	uint32_t _trans_queued;
+	uint32_t _trans_done;
+	uint8_t * _buffer[SPI_BUFFER_COUNT];
+	uint32_t _buffer_seq[SPI_BUFFER_COUNT];
+	uint8_t _buffer_index;
+	uint8_t * _fill;
+	bool _fill_valid;
+	uint16_t _fill_color;
+	uint32_t _fill_seq;
+	uint16_t _polling_threshold;
+	uint32_t _bulk_seq;
+	uint32_t _polling_count;
+	uint32_t _interrupt_count;
+	bool _window_valid;
+	bool _ram_write;
+	uint16_t _window_x1;
+	uint16_t _window_x2;
+	uint16_t _window_y1;
+	uint16_t _window_y2;
+	uint16_t _cursor_x;
+	uint16_t _cursor_y;
+	uint32_t _window_count;
+	uint32_t _window_skip;
+	uint16_t * _fb;
+	uint16_t * _fb_last;
+	uint8_t * _fb_dirty;
+	bool _fb_full;
+	uint16_t _fb_x1;
+	uint16_t _fb_x2;
+	uint16_t _fb_y1;
+	uint16_t _fb_y2;
+	uint16_t _fb_cx;
+	uint16_t _fb_cy;
+	struct DISPLAY_LIST * _dl;
+	struct SPI_RING * _ring;
+	struct MARQUEE * _marquee;
+#if LCD_STATS
+	LCD_STATS_t _stats;
+#endif
 } TFT_t;
 
+#ifdef ESP_PLATFORM
 void spi_master_init(TFT_t * dev, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL);
-bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength);
+void spi_master_init_host(TFT_t * dev, spi_host_device_t host, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL);
+#endif
+void lcdInitTransport(TFT_t * dev, const LCD_TRANSPORT_t * transport, void * ctx);
+void lcdDeinitTransport(TFT_t * dev);
+bool spi_master_write_byte(TFT_t * dev, const uint8_t* Data, size_t DataLength, int16_t dc);
+void spi_master_flush(TFT_t * dev);
 bool spi_master_write_comm_byte(TFT_t * dev, uint8_t cmd);
 bool spi_master_write_comm_word(TFT_t * dev, uint16_t cmd);
 bool spi_master_write_data_byte(TFT_t * dev, uint8_t data);
 bool spi_master_write_data_word(TFT_t * dev, uint16_t data);
 bool spi_master_write_addr(TFT_t * dev, uint16_t addr1, uint16_t addr2);
-bool spi_master_write_color(TFT_t * dev, uint16_t color, uint16_t size);
-bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint16_t size);
+bool spi_master_write_color(TFT_t * dev, uint16_t color, uint32_t size);
+bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint32_t size);
+void spi_master_write_window(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
 
 void delayMS(int ms);
 void lcdWriteRegisterWord(TFT_t * dev, uint16_t addr, uint16_t data);
@@ -52,35 +185,66 @@ void lcdWriteRegisterByte(TFT_t * dev, uint8_t addr, uint16_t data);
 void lcdInit(TFT_t * dev, uint16_t model, int width, int height, int offsetx, int offsety);
 void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color);
 void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint16_t * colors);
+bool lcdBeginPixels(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void lcdPushPixels(TFT_t * dev, uint16_t * colors, uint32_t size);
+void lcdEndPixels(TFT_t * dev);
+void lcdDrawBitmap(TFT_t * dev, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t * colors);
+void lcdDrawRowSource(TFT_t * dev, uint16_t x, uint16_t y, uint16_t w, uint16_t h, lcdRowSource_t source, void * arg);
 void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
 void lcdDisplayOff(TFT_t * dev);
 void lcdDisplayOn(TFT_t * dev);
 void lcdInversionOff(TFT_t * dev);
 void lcdInversionOn(TFT_t * dev);
 void lcdBGRFilter(TFT_t * dev);
+void lcdSetGRAMSize(TFT_t * dev, uint16_t width, uint16_t height);
+bool lcdSetRotation(TFT_t * dev, uint16_t rotation);
 void lcdFillScreen(TFT_t * dev, uint16_t color);
 void lcdDrawLine(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
 void lcdDrawRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
 void lcdDrawCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t color);
 void lcdDrawFillCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t color);
 void lcdDrawRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t r, uint16_t color);
+void lcdDrawFillRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t r, uint16_t color);
+void lcdDrawFillTriangle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
 void lcdDrawArrow(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t w, uint16_t color);
 void lcdDrawFillArrow(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t w, uint16_t color);
 uint16_t rgb565_conv(uint16_t r, uint16_t g, uint16_t b);
+uint16_t rgb565_wire(uint16_t r, uint16_t g, uint16_t b);
 int lcdDrawChar(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t ascii, uint16_t color);
 int lcdDrawString(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t * ascii, uint16_t color);
-//int lcdDrawSJISChar(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint16_t sjis, uint16_t color);
-//int lcdDrawUTF8Char(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t *utf8, uint16_t color);
-//int lcdDrawUTF8String(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, unsigned char *utfs, uint16_t color);
+int lcdDrawSJISChar(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint16_t sjis, uint16_t color);
+int lcdDrawUTF8Char(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, uint8_t *utf8, uint16_t color);
+int lcdDrawUTF8String(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, unsigned char *utfs, uint16_t color);
 void lcdSetFontDirection(TFT_t * dev, uint16_t);
+void lcdSetPixelFormat(TFT_t * dev, uint16_t format);
 void lcdSetFontFill(TFT_t * dev, uint16_t color);
 void lcdUnsetFontFill(TFT_t * dev);
 void lcdSetFontUnderLine(TFT_t * dev, uint16_t color);
 void lcdUnsetFontUnderLine(TFT_t * dev);
+void lcdSetFontScale(TFT_t * dev, uint16_t scale);
+void lcdUnsetFontScale(TFT_t * dev);
+void lcdSetAsync(TFT_t * dev);
+void lcdUnsetAsync(TFT_t * dev);
+void lcdFence(TFT_t * dev);
+void lcdSetPollingThreshold(TFT_t * dev, uint16_t bytes);
+bool lcdSetFrameBuffer(TFT_t * dev);
+void lcdUnsetFrameBuffer(TFT_t * dev);
+void lcdFlush(TFT_t * dev);
+bool lcdSetDisplayList(TFT_t * dev);
+void lcdUnsetDisplayList(TFT_t * dev);
+bool lcdSetFlushTask(TFT_t * dev, int core);
+void lcdUnsetFlushTask(TFT_t * dev);
 void lcdBacklightOff(TFT_t * dev);
 void lcdBacklightOn(TFT_t * dev);
 void lcdSetScrollArea(TFT_t * dev, uint16_t tfa, uint16_t vsa, uint16_t bfa);
 void lcdResetScrollArea(TFT_t * dev);
 void lcdScroll(TFT_t * dev, uint16_t vsp);
+bool lcdSetMarquee(TFT_t * dev, FontxFile *fx, uint16_t y, uint8_t * utfs, uint16_t color);
+bool lcdMarqueeScroll(TFT_t * dev);
+void lcdUnsetMarquee(TFT_t * dev);
+#if LCD_STATS
+void lcdDumpStats(TFT_t * dev);
+void lcdResetStats(TFT_t * dev);
+#endif
 #endif /* _ILI9340_H_ */
 
@@ -0,0 +1,224 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <driver/spi_master.h>
+#include <driver/gpio.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+
+#include "ili9340.h"
+
+#define TAG "ILI9340"
+
+static const int SPI_Default_MOSI = 23;
+static const int SPI_Default_SCLK = 18;
+
+//static const int SPI_Frequency = SPI_MASTER_FREQ_20M;
+////static const int SPI_Frequency = SPI_MASTER_FREQ_26M;
+static const int SPI_Frequency = SPI_MASTER_FREQ_40M;
+////static const int SPI_Frequency = SPI_MASTER_FREQ_80M;
+
+// Pins of the buses initialized by spi_master_init_host()
+#define SPI_HOST_COUNT	4
+static struct {
+	bool used;
+	int16_t mosi;
+	int16_t sclk;
+} spi_bus[SPI_HOST_COUNT];
+
+// ESP-IDF SPI transport
+typedef struct {
+	spi_device_handle_t handle;
+	int16_t dc;
+	int16_t bl;
+	uint32_t queued;
+	spi_transaction_t trans[SPI_QUEUE_SIZE];
+} SPI_TRANSPORT_t;
+
+// The D/C level of a transaction travels in its user field
+// together with the GPIO number: (gpio << 1) | level
+#define SPI_DC_USER(gpio, level)	((void *)(intptr_t)(((gpio) << 1) | (level)))
+
+// Drive the D/C line just before the transaction goes on the wire
+static void IRAM_ATTR spi_master_pre_transfer(spi_transaction_t *t)
+{
+	int user = (int)(intptr_t)t->user;
+	gpio_set_level( user >> 1, user & 1 );
+}
+
+static void spi_transport_polling(void * ctx, const uint8_t * Data, size_t DataLength, int16_t dc)
+{
+	SPI_TRANSPORT_t * spi = ctx;
+	spi_transaction_t SPITransaction;
+	esp_err_t ret;
+
+	memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
+	SPITransaction.length = DataLength * 8;
+	SPITransaction.tx_buffer = Data;
+	SPITransaction.user = SPI_DC_USER(spi->dc, dc);
+	ret = spi_device_polling_transmit( spi->handle, &SPITransaction );
+	assert(ret==ESP_OK);
+}
+
+static void spi_transport_transmit(void * ctx, const uint8_t * Data, size_t DataLength, int16_t dc)
+{
+	SPI_TRANSPORT_t * spi = ctx;
+	spi_transaction_t SPITransaction;
+	esp_err_t ret;
+
+	memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
+	SPITransaction.length = DataLength * 8;
+	SPITransaction.tx_buffer = Data;
+	SPITransaction.user = SPI_DC_USER(spi->dc, dc);
+	ret = spi_device_transmit( spi->handle, &SPITransaction );
+	assert(ret==ESP_OK);
+}
+
+static void spi_transport_queue(void * ctx, const uint8_t * Data, size_t DataLength, int16_t dc)
+{
+	SPI_TRANSPORT_t * spi = ctx;
+	esp_err_t ret;
+
+	// The caller never has more than SPI_QUEUE_SIZE transactions in
+	// flight, so the oldest slot of the ring is free
+	spi_transaction_t *trans = &spi->trans[spi->queued % SPI_QUEUE_SIZE];
+	memset( trans, 0, sizeof( spi_transaction_t ) );
+	trans->length = DataLength * 8;
+	trans->user = SPI_DC_USER(spi->dc, dc);
+	if ( DataLength <= sizeof(trans->tx_data) ) {
+		// Short transfers are copied, so the caller's buffer can be reused
+		memcpy( trans->tx_data, Data, DataLength );
+		trans->flags = SPI_TRANS_USE_TXDATA;
+	} else {
+		trans->tx_buffer = Data;
+	}
+	ret = spi_device_queue_trans( spi->handle, trans, portMAX_DELAY );
+	assert(ret==ESP_OK);
+	spi->queued++;
+}
+
+static void spi_transport_result(void * ctx)
+{
+	SPI_TRANSPORT_t * spi = ctx;
+	spi_transaction_t *SPITransaction;
+	esp_err_t ret;
+
+	ret = spi_device_get_trans_result( spi->handle, &SPITransaction, portMAX_DELAY );
+	assert(ret==ESP_OK);
+}
+
+static void spi_transport_backlight(void * ctx, int level)
+{
+	SPI_TRANSPORT_t * spi = ctx;
+	if ( spi->bl >= 0 ) {
+		gpio_set_level( spi->bl, level );
+	}
+}
+
+static const LCD_TRANSPORT_t spi_transport = {
+	.polling = spi_transport_polling,
+	.transmit = spi_transport_transmit,
+	.queue = spi_transport_queue,
+	.result = spi_transport_result,
+	.backlight = spi_transport_backlight,
+};
+
+void spi_master_init(TFT_t * dev, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+{
+	spi_master_init_host(dev, HSPI_HOST, SPI_Default_MOSI, SPI_Default_SCLK, GPIO_CS, GPIO_DC, GPIO_RESET, GPIO_BL);
+}
+
+// Attach a panel to any SPI host.
+// Several panels may share a host; each TFT_t keeps its own bus state,
+// so different panels can be driven from different tasks at the same time.
+void spi_master_init_host(TFT_t * dev, spi_host_device_t host, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+{
+	esp_err_t ret;
+
+	ESP_LOGI(TAG, "host=%d GPIO_MOSI=%d GPIO_SCLK=%d",host,GPIO_MOSI,GPIO_SCLK);
+
+	ESP_LOGI(TAG, "GPIO_CS=%d",GPIO_CS);
+	gpio_reset_pin( GPIO_CS );
+	gpio_set_direction( GPIO_CS, GPIO_MODE_OUTPUT );
+	gpio_set_level( GPIO_CS, 0 );
+
+	ESP_LOGI(TAG, "GPIO_DC=%d",GPIO_DC);
+	gpio_reset_pin( GPIO_DC );
+	gpio_set_direction( GPIO_DC, GPIO_MODE_OUTPUT );
+	gpio_set_level( GPIO_DC, 0 );
+
+	ESP_LOGI(TAG, "GPIO_RESET=%d",GPIO_RESET);
+	if ( GPIO_RESET >= 0 ) {
+		gpio_reset_pin( GPIO_RESET );
+		gpio_set_direction( GPIO_RESET, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_RESET, 0 );
+		vTaskDelay( pdMS_TO_TICKS( 100 ) );
+		gpio_set_level( GPIO_RESET, 1 );
+	}
+
+	ESP_LOGI(TAG, "GPIO_BL=%d",GPIO_BL);
+	if ( GPIO_BL >= 0 ) {
+		gpio_reset_pin( GPIO_BL );
+		gpio_set_direction( GPIO_BL, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_BL, 0 );
+	}
+
+	spi_bus_config_t buscfg = {
+		.sclk_io_num = GPIO_SCLK,
+		.mosi_io_num = GPIO_MOSI,
+		.miso_io_num = -1,
+		.quadwp_io_num = -1,
+		.quadhd_io_num = -1,
+		.max_transfer_sz = SPI_FILL_PIXELS * 2,
+	};
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+	ret = spi_bus_initialize( host, &buscfg, SPI_DMA_CH_AUTO );
+#else
+	ret = spi_bus_initialize( host, &buscfg, (host == HSPI_HOST) ? 1 : 2 );
+#endif
+	ESP_LOGD(TAG, "spi_bus_initialize=%d",ret);
+	assert(host < SPI_HOST_COUNT);
+	if (ret == ESP_OK) {
+		spi_bus[host].used = true;
+		spi_bus[host].mosi = GPIO_MOSI;
+		spi_bus[host].sclk = GPIO_SCLK;
+	} else if (ret == ESP_ERR_INVALID_STATE) {
+		// The bus is already used by another panel, which must be on the same pins
+		if (!spi_bus[host].used) {
+			ESP_LOGW(TAG, "host=%d was initialized outside of this driver, its pins are not checked", host);
+		} else if (spi_bus[host].mosi != GPIO_MOSI || spi_bus[host].sclk != GPIO_SCLK) {
+			ESP_LOGE(TAG, "host=%d is used with GPIO_MOSI=%d GPIO_SCLK=%d, not GPIO_MOSI=%d GPIO_SCLK=%d",
+				host, spi_bus[host].mosi, spi_bus[host].sclk, GPIO_MOSI, GPIO_SCLK);
+			assert(spi_bus[host].mosi == GPIO_MOSI && spi_bus[host].sclk == GPIO_SCLK);
+		}
+	} else {
+		assert(ret==ESP_OK);
+	}
+
+	spi_device_interface_config_t devcfg={
+		.clock_speed_hz = SPI_Frequency,
+		.spics_io_num = GPIO_CS,
+		.queue_size = SPI_QUEUE_SIZE,
+		.flags = SPI_DEVICE_NO_DUMMY,
+		.pre_cb = spi_master_pre_transfer,
+	};
+
+	spi_device_handle_t handle;
+	ret = spi_bus_add_device( host, &devcfg, &handle);
+	ESP_LOGD(TAG, "spi_bus_add_device=%d",ret);
+	assert(ret==ESP_OK);
+
+	SPI_TRANSPORT_t * spi = heap_caps_malloc(sizeof(SPI_TRANSPORT_t), MALLOC_CAP_8BIT);
+	assert(spi != NULL);
+	spi->handle = handle;
+	spi->dc = GPIO_DC;
+	spi->bl = GPIO_BL;
+	spi->queued = 0;
+	dev->_dc = GPIO_DC;
+	dev->_bl = GPIO_BL;
+	lcdInitTransport(dev, &spi_transport, spi);
+}
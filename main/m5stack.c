@@ -8,6 +8,7 @@
 */
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -15,6 +16,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 #include "driver/gpio.h"
 
@@ -24,18 +26,18 @@
 
 #include "ili9340.h"
 #include "fontx.h"
-#include "bmpfile.h"
 #include "cmd.h"
+#include "view.h"
 
 
 // for M5Stack
-#define SCREEN_WIDTH  320
-#define SCREEN_HEIGHT 240
 #define CS_GPIO	14
 #define DC_GPIO	27
 #define RESET_GPIO 33
 #define BL_GPIO	32
 #define DISPLAY_LENGTH	26
+#define MARQUEE_STEP	(40 / portTICK_PERIOD_MS)
+#define MARQUEE_HOLD	(3000 / portTICK_PERIOD_MS)
 #define GPIO_INPUT_A GPIO_NUM_39
 #define GPIO_INPUT_B GPIO_NUM_38
 #define GPIO_INPUT_C GPIO_NUM_37
@@ -57,6 +59,17 @@ static const char *TAG = "M5STACK";
 extern const char metaweather_com_root_cert_pem_start[] asm("_binary_metaweather_com_root_cert_pem_start");
 extern const char metaweather_com_root_cert_pem_end[]	asm("_binary_metaweather_com_root_cert_pem_end");
 
+/* The font selected in menuconfig, linked into the app by the project
+   CMakeLists.txt when CONFIG_ESP_FONT_EMBEDDED is set.
+*/
+#if CONFIG_ESP_FONT_EMBEDDED && CONFIG_ESP_FONT_MINCYO
+extern const uint8_t font_start[]	asm("_binary_ILMH24XB_FNT_start");
+extern const uint8_t font_end[]		asm("_binary_ILMH24XB_FNT_end");
+#elif CONFIG_ESP_FONT_EMBEDDED
+extern const uint8_t font_start[]	asm("_binary_ILGH24XB_FNT_start");
+extern const uint8_t font_end[]		asm("_binary_ILGH24XB_FNT_end");
+#endif
+
 esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
 	static char *output_buffer; // Buffer to store response of http request from event handler
@@ -187,6 +200,9 @@ void buttonB(void *pvParameters)
 			TickType_t diffTick = endTick-startTick;
 			cmdBuf.command = CMD_VIEW2;
 			if (diffTick > 200) cmdBuf.command = CMD_VIEW5;
+#if CONFIG_ESP_LCD_STATS
+			if (diffTick > 500) cmdBuf.command = CMD_STATS;
+#endif
 			xQueueSend(xQueueCmd, &cmdBuf, 0);
 		}
 		vTaskDelay(1);
@@ -517,365 +533,38 @@ CJSON_PUBLIC(cJSON *) http_client_get(char * url)
 	return root;
 }
 
+#if CONFIG_ESP_LCD_STATS
+// Time to draw each view
+// Bucket i counts the views drawn in less than 2<<i milliseconds,
+// and the last bucket all the slower ones.
+#define VIEW_BUCKETS	10
+static uint32_t view_histogram[6][VIEW_BUCKETS];
 
-void show_datetime(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
-{
-	uint16_t ypos = (fontHeight*2)-1;
-	char work[64];
-	char *tp;
-	char *tp2;
-	uint8_t ascii[44];
-
-	strcpy(work, weather.time);
-	ESP_LOGD(TAG, "weather.time=%s", weather.time);
-	tp = strtok(work, "T");
-	ESP_LOGD(TAG, "tp=%s", tp);
-	tp2 = strtok(NULL, ".");
-	ESP_LOGD(TAG, "tp2=%s", tp2);
-	sprintf((char *)ascii, "%s %s", tp, tp2);
-	ESP_LOGD(TAG, "ascii=%s", (char *)ascii);
-	// center align
-	uint16_t title_len = strlen((char *)ascii) * fontWidth;
-	uint16_t xpos_title = 0;
-	if (SCREEN_WIDTH > title_len) xpos_title = (SCREEN_WIDTH - title_len) / 2;
-	lcdDrawString(dev, fx, xpos_title, ypos, ascii, YELLOW);
-}
-
-
-void view1(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
-{
-	uint8_t ascii[44];
-	char work[64];
-	char *tp;
-
-	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
-	show_datetime(dev, weather, fx, fontWidth, fontHeight);
-
-	uint16_t xpos = (fontWidth*4)-1;
-	uint16_t ypos = (fontHeight*4)-1;
-
-#if 0
-	strcpy(work, weather.latt_long);
-	tp = strtok(work, ",");
-	ESP_LOGD(TAG, "view1 tp=%s", tp);
-	sprintf((char *)ascii, "latt	:%s", tp);
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-	tp = strtok(NULL, ",");
-	ESP_LOGD(TAG, "view1 tp=%s", tp);
-	sprintf((char *)ascii, "long	:%s", tp);
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-	sprintf((char *)ascii, "timezone:%s", weather.timezone);
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-#endif
-
-	sprintf((char *)ascii, "weather  :%s", weather.daily[0].weather_state_name);
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-	strcpy(work, weather.sun_rise);
-	tp = strtok(work, "T");
-	tp = strtok(NULL, ".");
-	ESP_LOGD(TAG, "view1 tp=%s", tp);
-	sprintf((char *)ascii, "sunrise  :%s", tp);
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-	strcpy(work, weather.sun_set);
-	tp = strtok(work, "T");
-	tp = strtok(NULL, ".");
-	ESP_LOGD(TAG, "view1 tp=%s", tp);
-	sprintf((char *)ascii, "sunset   :%s", tp);
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-	if (weather.daily[0].the_temp > 0.0) {
-		sprintf((char *)ascii, "temp     :%4.1f", weather.daily[0].the_temp); 
-	} else {
-		sprintf((char *)ascii, "temp    :%5.1f", weather.daily[0].the_temp); 
-	}
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-#if 1
-	if (weather.daily[0].min_temp > 0.0) {
-		sprintf((char *)ascii, "temp(min):%4.1f", weather.daily[0].min_temp);
-	} else {
-		sprintf((char *)ascii, "temp(min):%5.1f", weather.daily[0].min_temp);
-	}
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	ypos = ypos + fontHeight;
-
-	if (weather.daily[0].max_temp > 0.0) {
-		sprintf((char *)ascii, "temp(max):%4.1f", weather.daily[0].max_temp);
-	} else {
-		sprintf((char *)ascii, "temp(max):%5.1f", weather.daily[0].max_temp);
-	}
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-#endif
-}
-
-void view2(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+static void view_stats_record(uint16_t command, int64_t elapsedTime)
 {
-	uint8_t ascii[44];
-	char work[64];
-
-	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
-	show_datetime(dev, weather, fx, fontWidth, fontHeight);
-
-	uint16_t xpos = (fontWidth*4)-1;
-	uint16_t ypos = (fontHeight*4)-1;
-	strcpy((char *)ascii, "Weather State");
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-
-	for(int i=0;i<6;i++) {
-		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
-		strcpy(work, &(weather.daily[i].applicable_date[5]));
-		ESP_LOGD(TAG, "work=%s", work);
-		sprintf((char *)ascii, "%.5s:%.12s", work, \
-			weather.daily[i].weather_state_name);
-		ypos = ypos + fontHeight;
-		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	}
+	int bucket = 0;
+	while (bucket < VIEW_BUCKETS - 1 && elapsedTime >= (2000LL << bucket)) bucket++;
+	view_histogram[command / CMD_VIEW1 - 1][bucket]++;
 }
 
-void view3(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+static void view_stats_dump(void)
 {
-	uint8_t ascii[44];
-	char work[64];
-
-	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
-	show_datetime(dev, weather, fx, fontWidth, fontHeight);
-
-	uint16_t xpos = (fontWidth*1)-1;
-	uint16_t ypos = (fontHeight*4)-1;
-	strcpy((char *)ascii, "Temperature(Avr,Max,Min)");
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-
-	for(int i=0;i<6;i++) {
-		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
-		strcpy(work, &(weather.daily[i].applicable_date[5]));
-		ESP_LOGD(TAG, "work=%s", work);
-		sprintf((char *)ascii, "%.5s:%5.1f %5.1f %5.1f", work, \
-			weather.daily[i].the_temp, \
-			weather.daily[i].max_temp, \
-			weather.daily[i].min_temp);
-		ypos = ypos + fontHeight;
-		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	char line[8 + VIEW_BUCKETS * 12];
+	int len = sprintf(line, "ms    ");
+	for(int bucket=0;bucket<VIEW_BUCKETS-1;bucket++) {
+		len += sprintf(&line[len], " <%-4d", 2 << bucket);
 	}
-}
-
-void bmp_display(TFT_t *dev, char * file, int ypos, int width, int height) {
-	// open requested file
-	FILE* fp;
-	esp_err_t ret;
-	fp = fopen(file, "rb");
-	if (fp == NULL) {
-		ESP_LOGW(TAG, "File not found [%s]", file);
-		return;
-	}
-
-	// read bmp header
-	bmpfile_t *result = (bmpfile_t*)malloc(sizeof(bmpfile_t));
-	ret = fread(result->header.magic, 1, 2, fp);
-	assert(ret == 2);
-	ESP_LOGD(TAG,"result->header.magic=%c %c", result->header.magic[0], result->header.magic[1]);
-	if (result->header.magic[0]!='B' || result->header.magic[1] != 'M') {
-		ESP_LOGW(TAG, "File is not BMP");
-		free(result);
-		fclose(fp);
-		return;
-	}
-	ret = fread(&result->header.filesz, 4, 1 , fp);
-	assert(ret == 1);
-	ESP_LOGD(TAG,"result->header.filesz=%d", result->header.filesz);
-	ret = fread(&result->header.creator1, 2, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->header.creator2, 2, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->header.offset, 4, 1, fp);
-	assert(ret == 1);
-
-	// read dib header
-	ret = fread(&result->dib.header_sz, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.width, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.height, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.nplanes, 2, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.depth, 2, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.compress_type, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.bmp_bytesz, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.hres, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.vres, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.ncolors, 4, 1, fp);
-	assert(ret == 1);
-	ret = fread(&result->dib.nimpcolors, 4, 1, fp);
-	assert(ret == 1);
-
-	if((result->dib.depth == 24) && (result->dib.compress_type == 0)) {
-		// BMP rows are padded (if needed) to 4-byte boundary
-		uint32_t rowSize = (result->dib.width * 3 + 3) & ~3;
-		int w = result->dib.width;
-		int h = result->dib.height;
-		ESP_LOGI(TAG,"w=%d h=%d", w, h);
-		int _x;
-		int _w;
-		int _cols;
-		int _cole;
-		if (width >= w) {
-			_x = (width - w) / 2;
-			_w = w;
-			_cols = 0;
-			_cole = w - 1;
-		} else {
-			_x = 0;
-			_w = width;
-			_cols = (w - width) / 2;
-			_cole = _cols + width - 1;
+	sprintf(&line[len], " >=%d", 1 << (VIEW_BUCKETS - 1));
+	ESP_LOGI(pcTaskGetName(0), "%s", line);
+	for(int view=0;view<6;view++) {
+		len = sprintf(line, "view%d ", view + 1);
+		for(int bucket=0;bucket<VIEW_BUCKETS;bucket++) {
+			len += sprintf(&line[len], " %5"PRIu32, view_histogram[view][bucket]);
 		}
-		ESP_LOGI(TAG,"_x=%d _w=%d _cols=%d _cole=%d",_x, _w, _cols, _cole);
-
-		int _y = ypos;
-		int _rows = 0;
-		int _rowe = h - 1;
-		ESP_LOGI(TAG,"_y=%d _rows=%d _rowe=%d", _y, _rows, _rowe);
-
-#define BUFFPIXEL 20
-		uint8_t sdbuffer[3*BUFFPIXEL]; // pixel buffer (R+G+B per pixel)
-		uint16_t *colors = (uint16_t*)malloc(sizeof(uint16_t) * w);
-
-		for (int row=0; row<h; row++) { // For each scanline...
-			if (row < _rows || row > _rowe) continue;
-			// Seek to start of scan line. It might seem labor-
-			// intensive to be doing this on every line, but this
-			// method covers a lot of gritty details like cropping
-			// and scanline padding. Also, the seek only takes
-			// place if the file position actually needs to change
-			// (avoids a lot of cluster math in SD library).
-			// Bitmap is stored bottom-to-top order (normal BMP)
-#if 1
-			int pos = result->header.offset + (h - 1 - row) * rowSize;
-			ESP_LOGD(TAG,"fseek start row=%d pos=%d",row, pos);
-			fseek(fp, pos, SEEK_SET);
-			ESP_LOGD(TAG,"fseek end	row=%d pos=%d",row, pos);
-#endif
-
-			int buffidx = sizeof(sdbuffer); // Force buffer reload
-
-			int index = 0;
-			for (int col=0; col<w; col++) { // For each pixel...
-				if (buffidx >= sizeof(sdbuffer)) { // Indeed
-					ESP_LOGD(TAG,"fread start row=%d",row);
-					fread(sdbuffer, sizeof(sdbuffer), 1, fp);
-					ESP_LOGD(TAG,"fread end row=%d",row);
-					buffidx = 0; // Set index to beginning
-				}
-				if (col < _cols || col > _cole) continue;
-				// Convert pixel from BMP to TFT format, push to display
-				uint8_t b = sdbuffer[buffidx++];
-				uint8_t g = sdbuffer[buffidx++];
-				uint8_t r = sdbuffer[buffidx++];
-				colors[index++] = rgb565_conv(r, g, b);
-			} // end for col
-			ESP_LOGD(TAG,"lcdDrawMultiPixels start row=%d",row);
-			lcdDrawMultiPixels(dev, _x, row+_y, _w, colors);
-			ESP_LOGD(TAG,"lcdDrawMultiPixels end row=%d",row);
-		} // end for row
-		free(colors);
-	} // end if 
-	ESP_LOGI(TAG,"bmp_display end");
-	free(result);
-	fclose(fp);
-	return;
-}
-
-void view4(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
-{
-	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
-	show_datetime(dev, weather, fx, fontWidth, fontHeight);
-
-	ESP_LOGI(TAG, "weather.daily[0].weather_state_abbr=%s",weather.daily[0].weather_state_abbr);
-	char file[32];
-	char dir[10];
-	strcpy(dir, "/images1");
-	if (strcmp(weather.daily[0].weather_state_abbr, "lr") == 0) {
-		strcpy(dir, "/images2");
-	} else if (strcmp(weather.daily[0].weather_state_abbr, "s") == 0) {
-		strcpy(dir, "/images2");
-	} else if (strcmp(weather.daily[0].weather_state_abbr, "sl") == 0) {
-		strcpy(dir, "/images2");
-	} else if (strcmp(weather.daily[0].weather_state_abbr, "sn") == 0) {
-		strcpy(dir, "/images2");
-	} else if (strcmp(weather.daily[0].weather_state_abbr, "t") == 0) {
-		strcpy(dir, "/images2");
-	}
-	sprintf(file, "%s/%s.bmp", dir, weather.daily[0].weather_state_abbr);
-	ESP_LOGI(TAG, "file=%s", file);
-	bmp_display(dev, file, fontHeight*2, SCREEN_WIDTH, SCREEN_HEIGHT);
-}
-
-void view5(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
-{
-	uint8_t ascii[44];
-	char work[64];
-
-	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
-	show_datetime(dev, weather, fx, fontWidth, fontHeight);
-
-	uint16_t xpos = (fontWidth*2)-1;
-	uint16_t ypos = (fontHeight*4)-1;
-	strcpy((char *)ascii, "Wind Speed/Direction");
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-
-	for(int i=0;i<6;i++) {
-		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
-		strcpy(work, &(weather.daily[i].applicable_date[5]));
-		ESP_LOGD(TAG, "work=%s", work);
-		sprintf((char *)ascii, "%.5s:%7.4f %5.1f(%.5s)", work, \
-			weather.daily[i].wind_speed,\
-			weather.daily[i].wind_direction,\
-			weather.daily[i].wind_direction_compass);
-		ypos = ypos + fontHeight;
-		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-	}
-}
-
-void view6(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
-{
-	uint8_t ascii[44];
-	char work[64];
-
-	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
-	show_datetime(dev, weather, fx, fontWidth, fontHeight);
-
-	uint16_t xpos = (fontWidth*4)-1;
-	uint16_t ypos = (fontHeight*4)-1;
-	strcpy((char *)ascii, "Pressure/Humidity");
-	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
-
-	for(int i=0;i<6;i++) {
-		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
-		strcpy(work, &(weather.daily[i].applicable_date[5]));
-		ESP_LOGD(TAG, "work=%s", work);
-		sprintf((char *)ascii, "%.5s:%6.1f %3d", work, \
-			weather.daily[i].air_pressure, \
-			weather.daily[i].humidity);
-		ypos = ypos + fontHeight;
-		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+		ESP_LOGI(pcTaskGetName(0), "%s", line);
 	}
 }
+#endif
 
 void tft(void *pvParameters)
 {
@@ -885,11 +574,15 @@ void tft(void *pvParameters)
 
 	// Set font file
 	FontxFile fx[2];
+#if CONFIG_ESP_FONT_EMBEDDED
+	InitFontxMemory(fx, font_start, font_end - font_start); // Linked into the app
+#else
 #if CONFIG_ESP_FONT_GOTHIC
 	InitFontx(fx,"/fonts/ILGH24XB.FNT",""); // 12x24Dot Gothic
 #endif
 #if CONFIG_ESP_FONT_MINCYO
 	InitFontx(fx,"/fonts/ILMH24XB.FNT",""); // 12x24Dot Mincyo
+#endif
 #endif
 
 	// Get font width & height
@@ -903,6 +596,22 @@ void tft(void *pvParameters)
 	TFT_t dev;
 	spi_master_init(&dev, CS_GPIO, DC_GPIO, RESET_GPIO, BL_GPIO);
 	lcdInit(&dev, 0x9341, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 0);
+	lcdSetAsync(&dev);
+#if CONFIG_ESP_FLUSH_TASK
+	if (lcdSetFlushTask(&dev, PRO_CPU_NUM) == false) {
+		ESP_LOGW(pcTaskGetName(0), "Flush task not available, drawing on one core");
+	}
+#endif
+#if CONFIG_ESP_FRAME_BUFFER
+	if (lcdSetFrameBuffer(&dev) == false) {
+		ESP_LOGW(pcTaskGetName(0), "Frame buffer not available, drawing directly");
+	}
+#endif
+#if CONFIG_ESP_DISPLAY_LIST
+	if (lcdSetDisplayList(&dev) == false) {
+		ESP_LOGW(pcTaskGetName(0), "Display list not available, drawing directly");
+	}
+#endif
 	ESP_LOGI(pcTaskGetName(0), "Setup Screen done");
 
 	int lines = (SCREEN_HEIGHT - fontHeight) / fontHeight;
@@ -913,9 +622,11 @@ void tft(void *pvParameters)
 	// Clear Screen
 	lcdFillScreen(&dev, BLACK);
 	lcdSetFontDirection(&dev, 0);
+	// All text is drawn on black, so each character can be written as one block
+	lcdSetFontFill(&dev, BLACK);
 
 	// Reset scroll area
-	lcdSetScrollArea(&dev, 0, 0x0140, 0);
+	lcdSetScrollArea(&dev, 0, SCREEN_HEIGHT, 0);
 
 	// Get Weather Information
 	ESP_LOGI(pcTaskGetName(0), "woeid=%d",CONFIG_ESP_WOEID);
@@ -937,15 +648,26 @@ void tft(void *pvParameters)
 	// Show header
 	uint8_t ascii[44];
 	uint16_t ypos = fontHeight-1;
-	if (strlen(weather.title) < 13) {
-		sprintf((char *)ascii, "World Weather %.12s", weather.title);
-	} else {
-		sprintf((char *)ascii, "%.26s", weather.title);
+	bool marquee = false;
+#if CONFIG_ESP_TITLE_MARQUEE
+	// Roll the whole title through the header when it does not fit
+	uint8_t title[64];
+	sprintf((char *)title, "World Weather %s", weather.title);
+	marquee = lcdSetMarquee(&dev, fx, ypos, title, YELLOW);
+#endif
+	if (!marquee) {
+		if (strlen(weather.title) < 13) {
+			sprintf((char *)ascii, "World Weather %.12s", weather.title);
+		} else {
+			sprintf((char *)ascii, "%.26s", weather.title);
+		}
+		// Titles such as "São Paulo" are UTF-8
+		uint16_t sjis[44];
+		uint16_t title_len = String2SJIS(ascii, strlen((char *)ascii), sjis, 44) * fontWidth;
+		uint16_t xpos_title = 0;
+		if (SCREEN_WIDTH > title_len) xpos_title = (SCREEN_WIDTH - title_len) / 2;
+		lcdDrawUTF8String(&dev, fx, xpos_title, ypos, ascii, YELLOW);
 	}
-	uint16_t title_len = strlen((char *)ascii) * fontWidth;
-	uint16_t xpos_title = 0;
-	if (SCREEN_WIDTH > title_len) xpos_title = (SCREEN_WIDTH - title_len) / 2;
-	lcdDrawString(&dev, fx, xpos_title, ypos, ascii, YELLOW);
 
 	// Show screen
 	//view1(&dev, weather, fx, fontWidth, fontHeight);
@@ -963,12 +685,19 @@ void tft(void *pvParameters)
 		func = view6;
 	}
 	(*func)(&dev, weather, fx, fontWidth, fontHeight);
+	lcdFlush(&dev);
 
 	CMD_t cmdBuf;
+	TickType_t wait = marquee ? MARQUEE_HOLD : portMAX_DELAY;
 
 	while(1) {
-		xQueueReceive(xQueueCmd, &cmdBuf, portMAX_DELAY);
+		if (xQueueReceive(xQueueCmd, &cmdBuf, wait) != pdTRUE) {
+			// Roll the title by one row, and hold each page for a while
+			wait = lcdMarqueeScroll(&dev) ? MARQUEE_HOLD : MARQUEE_STEP;
+			continue;
+		}
 		ESP_LOGI(pcTaskGetName(0),"cmdBuf.command=%d", cmdBuf.command);
+		int64_t startTime = esp_timer_get_time();
 		if (cmdBuf.command == CMD_VIEW1) {
 			view1(&dev, weather, fx, fontWidth, fontHeight);
 			func = view1;
@@ -998,7 +727,28 @@ void tft(void *pvParameters)
 			StructSort(&weather);
 			cJSON_Delete(root);
 			(*func)(&dev, weather, fx, fontWidth, fontHeight);
+#if CONFIG_ESP_LCD_STATS
+		} else if (cmdBuf.command == CMD_STATS) {
+			// Log everything counted since the last time, and start again
+			lcdDumpStats(&dev);
+			view_stats_dump();
+			ESP_LOGI(pcTaskGetName(0), "font cache hits=%"PRIu32" misses=%"PRIu32, fx[0].hits, fx[0].misses);
+			lcdResetStats(&dev);
+			memset(view_histogram, 0, sizeof(view_histogram));
+			fx[0].hits = 0;
+			fx[0].misses = 0;
+			continue;
+#endif
 		}
+		lcdFlush(&dev);
+		lcdFence(&dev);
+		int64_t elapsedTime = esp_timer_get_time() - startTime;
+		ESP_LOGI(pcTaskGetName(0),"view drawn in %"PRId64" us", elapsedTime);
+#if CONFIG_ESP_LCD_STATS
+		// An update also waits for the server
+		if (cmdBuf.command != CMD_UPDATE) view_stats_record(cmdBuf.command, elapsedTime);
+#endif
+		ESP_LOGI(pcTaskGetName(0),"window commands sent=%"PRIu32" elided=%"PRIu32, dev._window_count, dev._window_skip);
 	}
 
 	// nerver reach
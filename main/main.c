@@ -235,11 +235,14 @@ void app_main()
 	
 	// Initialize SPIFFS
 	ESP_LOGI(TAG, "Initializing SPIFFS");
+#if !CONFIG_ESP_FONT_EMBEDDED
+	// The font is in the app otherwise
 	if (SPIFFS_Mount("/fonts", "storage0", 7) != ESP_OK)
 	{
 		ESP_LOGE(TAG, "SPIFFS mount failed");
 		while(1) { vTaskDelay(1); }
 	}
+#endif
 
 	if (SPIFFS_Mount("/images1", "storage1", 5) != ESP_OK)
 	{
@@ -280,5 +283,10 @@ void app_main()
 	xTaskCreate(buttonB, "BUTTON2", 1024*2, NULL, 2, NULL);
 	xTaskCreate(buttonC, "BUTTON3", 1024*2, NULL, 2, NULL);
 	int32_t screen_type = 1;
+#if CONFIG_ESP_FLUSH_TASK
+	// The LCD flush task runs on the PRO CPU
+	xTaskCreatePinnedToCore(tft, "TFT", 1024*8, (void *)screen_type, 5, NULL, APP_CPU_NUM);
+#else
 	xTaskCreate(tft, "TFT", 1024*8, (void *)screen_type, 5, NULL);
+#endif
 }
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Generate utf8sjis.c, the Unicode to SJIS table of fontx.c
+
+   usage: python3 utf8sjis.py > utf8sjis.c
+
+Every character of the BMP that Shift_JIS (JIS X 0201/0208) has is mapped
+to its SJIS code. Latin letters with accents, which SJIS does not have,
+are mapped to the ASCII letter they are based on.
+
+The table has a page for each 256 code points with any character:
+Utf8SjisIndex gives the page+1 of the high byte (0:no page), and the
+page has a bit for each low byte, the number of bits set before each
+32 bit word, and the first of its codes in Utf8SjisCodes.
+"""
+import unicodedata
+
+# Letters with no decomposition
+LATIN = {
+	0x00D0: 'D', 0x00D8: 'O', 0x00DE: 'T', 0x00F0: 'd', 0x00F8: 'o', 0x00FE: 't',
+	0x0110: 'D', 0x0111: 'd', 0x0126: 'H', 0x0127: 'h', 0x0131: 'i', 0x0141: 'L',
+	0x0142: 'l', 0x014A: 'N', 0x014B: 'n', 0x0166: 'T', 0x0167: 't',
+}
+
+
+def sjis(cp):
+	try:
+		b = chr(cp).encode('shift_jis')
+	except UnicodeEncodeError:
+		b = None
+	if b:
+		return b[0] if len(b) == 1 else (b[0] << 8) | b[1]
+	if cp in LATIN:
+		return ord(LATIN[cp])
+	if 0x00C0 <= cp < 0x0250:
+		base = unicodedata.normalize('NFD', chr(cp))[0]
+		if base.isascii() and base.isalpha():
+			return ord(base)
+	return None
+
+
+def main():
+	table = {}
+	for cp in range(0x80, 0x10000):
+		if 0xD800 <= cp < 0xE000:
+			continue
+		code = sjis(cp)
+		if code is not None:
+			table[cp] = code
+
+	index = [0] * 256
+	pages = []
+	codes = []
+	for high in range(256):
+		low = [cp & 0xFF for cp in sorted(table) if cp >> 8 == high]
+		if not low:
+			continue
+		bits = [0] * 8
+		for l in low:
+			bits[l // 32] |= 1 << (l % 32)
+		rank = []
+		count = 0
+		for w in range(8):
+			rank.append(count)
+			count += bin(bits[w]).count('1')
+		pages.append((len(codes), rank, bits))
+		codes.extend(table[(high << 8) | l] for l in low)
+		index[high] = len(pages)
+
+	print('/* Generated by utf8sjis.py. Do not edit. */')
+	print('#include <stdio.h>')
+	print('#include <stdint.h>')
+	print('#include <stdbool.h>')
+	print('#include "fontx.h"')
+	print()
+	print('const uint8_t Utf8SjisIndex[256] = {')
+	for i in range(0, 256, 16):
+		print('\t' + ', '.join('%d' % v for v in index[i:i+16]) + ',')
+	print('};')
+	print()
+	print('const FontxSjisPage Utf8SjisPages[%d] = {' % len(pages))
+	for base, rank, bits in pages:
+		print('\t{ %d, { %s },' % (base, ', '.join('%d' % r for r in rank)))
+		print('\t  { %s } },' % ', '.join('0x%08x' % b for b in bits))
+	print('};')
+	print()
+	print('const uint16_t Utf8SjisCodes[%d] = {' % len(codes))
+	for i in range(0, len(codes), 12):
+		print('\t' + ', '.join('0x%04x' % c for c in codes[i:i+12]) + ',')
+	print('};')
+
+
+if __name__ == '__main__':
+	main()
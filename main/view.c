@@ -0,0 +1,386 @@
+/* World Weather views
+
+	 This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+	 Unless required by applicable law or agreed to in writing, this
+	 software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+	 CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "bmpfile.h"
+#include "view.h"
+
+static const char *TAG = "VIEW";
+
+void show_datetime(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	uint16_t ypos = (fontHeight*2)-1;
+	char work[64];
+	char *tp;
+	char *tp2;
+	uint8_t ascii[44];
+
+	strcpy(work, weather.time);
+	ESP_LOGD(TAG, "weather.time=%s", weather.time);
+	tp = strtok(work, "T");
+	ESP_LOGD(TAG, "tp=%s", tp);
+	tp2 = strtok(NULL, ".");
+	ESP_LOGD(TAG, "tp2=%s", tp2);
+	sprintf((char *)ascii, "%s %s", tp, tp2);
+	ESP_LOGD(TAG, "ascii=%s", (char *)ascii);
+	// center align
+	uint16_t title_len = strlen((char *)ascii) * fontWidth;
+	uint16_t xpos_title = 0;
+	if (SCREEN_WIDTH > title_len) xpos_title = (SCREEN_WIDTH - title_len) / 2;
+	lcdDrawString(dev, fx, xpos_title, ypos, ascii, YELLOW);
+}
+
+
+void view1(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	uint8_t ascii[44];
+	char work[64];
+	char *tp;
+
+	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
+	show_datetime(dev, weather, fx, fontWidth, fontHeight);
+
+	uint16_t xpos = (fontWidth*4)-1;
+	uint16_t ypos = (fontHeight*4)-1;
+
+#if 0
+	strcpy(work, weather.latt_long);
+	tp = strtok(work, ",");
+	ESP_LOGD(TAG, "view1 tp=%s", tp);
+	sprintf((char *)ascii, "latt	:%s", tp);
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+	tp = strtok(NULL, ",");
+	ESP_LOGD(TAG, "view1 tp=%s", tp);
+	sprintf((char *)ascii, "long	:%s", tp);
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+	sprintf((char *)ascii, "timezone:%s", weather.timezone);
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+#endif
+
+	sprintf((char *)ascii, "weather  :%s", weather.daily[0].weather_state_name);
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+	strcpy(work, weather.sun_rise);
+	tp = strtok(work, "T");
+	tp = strtok(NULL, ".");
+	ESP_LOGD(TAG, "view1 tp=%s", tp);
+	sprintf((char *)ascii, "sunrise  :%s", tp);
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+	strcpy(work, weather.sun_set);
+	tp = strtok(work, "T");
+	tp = strtok(NULL, ".");
+	ESP_LOGD(TAG, "view1 tp=%s", tp);
+	sprintf((char *)ascii, "sunset   :%s", tp);
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+	if (weather.daily[0].the_temp > 0.0) {
+		sprintf((char *)ascii, "temp     :%4.1f", weather.daily[0].the_temp); 
+	} else {
+		sprintf((char *)ascii, "temp    :%5.1f", weather.daily[0].the_temp); 
+	}
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+#if 1
+	if (weather.daily[0].min_temp > 0.0) {
+		sprintf((char *)ascii, "temp(min):%4.1f", weather.daily[0].min_temp);
+	} else {
+		sprintf((char *)ascii, "temp(min):%5.1f", weather.daily[0].min_temp);
+	}
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	ypos = ypos + fontHeight;
+
+	if (weather.daily[0].max_temp > 0.0) {
+		sprintf((char *)ascii, "temp(max):%4.1f", weather.daily[0].max_temp);
+	} else {
+		sprintf((char *)ascii, "temp(max):%5.1f", weather.daily[0].max_temp);
+	}
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+#endif
+}
+
+void view2(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	uint8_t ascii[44];
+	char work[64];
+
+	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
+	show_datetime(dev, weather, fx, fontWidth, fontHeight);
+
+	uint16_t xpos = (fontWidth*4)-1;
+	uint16_t ypos = (fontHeight*4)-1;
+	strcpy((char *)ascii, "Weather State");
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+
+	for(int i=0;i<6;i++) {
+		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
+		strcpy(work, &(weather.daily[i].applicable_date[5]));
+		ESP_LOGD(TAG, "work=%s", work);
+		sprintf((char *)ascii, "%.5s:%.12s", work, \
+			weather.daily[i].weather_state_name);
+		ypos = ypos + fontHeight;
+		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	}
+}
+
+void view3(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	uint8_t ascii[44];
+	char work[64];
+
+	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
+	show_datetime(dev, weather, fx, fontWidth, fontHeight);
+
+	uint16_t xpos = (fontWidth*1)-1;
+	uint16_t ypos = (fontHeight*4)-1;
+	strcpy((char *)ascii, "Temperature(Avr,Max,Min)");
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+
+	for(int i=0;i<6;i++) {
+		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
+		strcpy(work, &(weather.daily[i].applicable_date[5]));
+		ESP_LOGD(TAG, "work=%s", work);
+		sprintf((char *)ascii, "%.5s:%5.1f %5.1f %5.1f", work, \
+			weather.daily[i].the_temp, \
+			weather.daily[i].max_temp, \
+			weather.daily[i].min_temp);
+		ypos = ypos + fontHeight;
+		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	}
+}
+
+typedef struct {
+	FILE * fp;
+	uint32_t offset;
+	uint32_t rowSize;
+	int h;
+	int cols;
+	int rows;
+} BMP_SOURCE_t;
+
+// Read one row of a 24 bit BMP file
+// The colors are in wire order (PIXEL_WIRE).
+void bmp_row(void * arg, uint16_t row, uint16_t * colors, uint16_t width) {
+	BMP_SOURCE_t * source = (BMP_SOURCE_t *)arg;
+	// Bitmap is stored bottom-to-top order (normal BMP)
+	int pos = source->offset + (source->h - 1 - (source->rows + row)) * source->rowSize + source->cols * 3;
+	ESP_LOGD(TAG,"fseek start row=%d pos=%d",row, pos);
+	fseek(source->fp, pos, SEEK_SET);
+
+#define BUFFPIXEL 20
+	uint8_t sdbuffer[3*BUFFPIXEL]; // pixel buffer (R+G+B per pixel)
+	size_t buffidx = sizeof(sdbuffer); // Force buffer reload
+	for (int col=0; col<width; col++) { // For each pixel...
+		if (buffidx >= sizeof(sdbuffer)) { // Indeed
+			fread(sdbuffer, sizeof(sdbuffer), 1, source->fp);
+			buffidx = 0; // Set index to beginning
+		}
+		// Convert pixel from BMP to TFT format
+		uint8_t b = sdbuffer[buffidx++];
+		uint8_t g = sdbuffer[buffidx++];
+		uint8_t r = sdbuffer[buffidx++];
+		colors[col] = rgb565_wire(r, g, b);
+	}
+}
+
+void bmp_display(TFT_t *dev, char * file, int ypos, int width) {
+	// open requested file
+	FILE* fp;
+	esp_err_t ret;
+	fp = fopen(file, "rb");
+	if (fp == NULL) {
+		ESP_LOGW(TAG, "File not found [%s]", file);
+		return;
+	}
+
+	// read bmp header
+	bmpfile_t *result = (bmpfile_t*)malloc(sizeof(bmpfile_t));
+	ret = fread(result->header.magic, 1, 2, fp);
+	assert(ret == 2);
+	ESP_LOGD(TAG,"result->header.magic=%c %c", result->header.magic[0], result->header.magic[1]);
+	if (result->header.magic[0]!='B' || result->header.magic[1] != 'M') {
+		ESP_LOGW(TAG, "File is not BMP");
+		free(result);
+		fclose(fp);
+		return;
+	}
+	ret = fread(&result->header.filesz, 4, 1 , fp);
+	assert(ret == 1);
+	ESP_LOGD(TAG,"result->header.filesz=%d", result->header.filesz);
+	ret = fread(&result->header.creator1, 2, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->header.creator2, 2, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->header.offset, 4, 1, fp);
+	assert(ret == 1);
+
+	// read dib header
+	ret = fread(&result->dib.header_sz, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.width, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.height, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.nplanes, 2, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.depth, 2, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.compress_type, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.bmp_bytesz, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.hres, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.vres, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.ncolors, 4, 1, fp);
+	assert(ret == 1);
+	ret = fread(&result->dib.nimpcolors, 4, 1, fp);
+	assert(ret == 1);
+
+	if((result->dib.depth == 24) && (result->dib.compress_type == 0)) {
+		// BMP rows are padded (if needed) to 4-byte boundary
+		uint32_t rowSize = (result->dib.width * 3 + 3) & ~3;
+		int w = result->dib.width;
+		int h = result->dib.height;
+		ESP_LOGI(TAG,"w=%d h=%d", w, h);
+		int _x;
+		int _w;
+		int _cols;
+		int _cole;
+		if (width >= w) {
+			_x = (width - w) / 2;
+			_w = w;
+			_cols = 0;
+			_cole = w - 1;
+		} else {
+			_x = 0;
+			_w = width;
+			_cols = (w - width) / 2;
+			_cole = _cols + width - 1;
+		}
+		ESP_LOGI(TAG,"_x=%d _w=%d _cols=%d _cole=%d",_x, _w, _cols, _cole);
+
+		int _y = ypos;
+		int _rows = 0;
+		int _rowe = h - 1;
+		if (_y + _rowe >= dev->_height) _rowe = dev->_height - 1 - _y;
+		ESP_LOGI(TAG,"_y=%d _rows=%d _rowe=%d", _y, _rows, _rowe);
+
+		BMP_SOURCE_t source;
+		source.fp = fp;
+		source.offset = result->header.offset;
+		source.rowSize = rowSize;
+		source.h = h;
+		source.cols = _cols;
+		source.rows = _rows;
+		// Rows are read from the file while they are drawn,
+		// straight into the buffers sent to the panel
+		if (_rowe >= _rows) {
+			lcdSetPixelFormat(dev, PIXEL_WIRE);
+			lcdDrawRowSource(dev, _x, _y, _w, _rowe - _rows + 1, bmp_row, &source);
+			lcdSetPixelFormat(dev, PIXEL_HOST);
+			lcdFlush(dev);
+		}
+	} // end if 
+	ESP_LOGI(TAG,"bmp_display end");
+	free(result);
+	fclose(fp);
+	return;
+}
+
+void view4(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
+	show_datetime(dev, weather, fx, fontWidth, fontHeight);
+
+	ESP_LOGI(TAG, "weather.daily[0].weather_state_abbr=%s",weather.daily[0].weather_state_abbr);
+	char file[sizeof(IMAGE_DIR)+32];
+	char dir[10];
+	strcpy(dir, "/images1");
+	if (strcmp(weather.daily[0].weather_state_abbr, "lr") == 0) {
+		strcpy(dir, "/images2");
+	} else if (strcmp(weather.daily[0].weather_state_abbr, "s") == 0) {
+		strcpy(dir, "/images2");
+	} else if (strcmp(weather.daily[0].weather_state_abbr, "sl") == 0) {
+		strcpy(dir, "/images2");
+	} else if (strcmp(weather.daily[0].weather_state_abbr, "sn") == 0) {
+		strcpy(dir, "/images2");
+	} else if (strcmp(weather.daily[0].weather_state_abbr, "t") == 0) {
+		strcpy(dir, "/images2");
+	}
+	sprintf(file, IMAGE_DIR "%s/%s.bmp", dir, weather.daily[0].weather_state_abbr);
+	ESP_LOGI(TAG, "file=%s", file);
+	bmp_display(dev, file, fontHeight*2, SCREEN_WIDTH);
+}
+
+void view5(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	uint8_t ascii[44];
+	char work[64];
+
+	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
+	show_datetime(dev, weather, fx, fontWidth, fontHeight);
+
+	uint16_t xpos = (fontWidth*2)-1;
+	uint16_t ypos = (fontHeight*4)-1;
+	strcpy((char *)ascii, "Wind Speed/Direction");
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+
+	for(int i=0;i<6;i++) {
+		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
+		strcpy(work, &(weather.daily[i].applicable_date[5]));
+		ESP_LOGD(TAG, "work=%s", work);
+		sprintf((char *)ascii, "%.5s:%7.4f %5.1f(%.5s)", work, \
+			weather.daily[i].wind_speed,\
+			weather.daily[i].wind_direction,\
+			weather.daily[i].wind_direction_compass);
+		ypos = ypos + fontHeight;
+		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	}
+}
+
+void view6(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight)
+{
+	uint8_t ascii[44];
+	char work[64];
+
+	lcdDrawFillRect(dev, 0, (fontHeight*1), SCREEN_WIDTH-1, SCREEN_HEIGHT-1, BLACK);
+	show_datetime(dev, weather, fx, fontWidth, fontHeight);
+
+	uint16_t xpos = (fontWidth*4)-1;
+	uint16_t ypos = (fontHeight*4)-1;
+	strcpy((char *)ascii, "Pressure/Humidity");
+	lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+
+	for(int i=0;i<6;i++) {
+		ESP_LOGD(TAG, "applicable_date=%s", weather.daily[i].applicable_date);
+		strcpy(work, &(weather.daily[i].applicable_date[5]));
+		ESP_LOGD(TAG, "work=%s", work);
+		sprintf((char *)ascii, "%.5s:%6.1f %3d", work, \
+			weather.daily[i].air_pressure, \
+			weather.daily[i].humidity);
+		ypos = ypos + fontHeight;
+		lcdDrawString(dev, fx, xpos, ypos, ascii, CYAN);
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef MAIN_VIEW_H_
+#define MAIN_VIEW_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ili9340.h"
+#include "fontx.h"
+#include "cmd.h"
+
+// for M5Stack
+#define SCREEN_WIDTH  320
+#define SCREEN_HEIGHT 240
+
+// Prefix of the /images1 and /images2 mount points
+#ifndef IMAGE_DIR
+#define IMAGE_DIR ""
+#endif
+
+void show_datetime(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void view1(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void view2(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void view3(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void view4(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void view5(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void view6(TFT_t *dev, WEATHER_t weather, FontxFile *fx, uint8_t fontWidth, uint8_t fontHeight);
+void bmp_display(TFT_t *dev, char * file, int ypos, int width);
+
+#endif /* MAIN_VIEW_H_ */